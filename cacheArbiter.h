@@ -0,0 +1,209 @@
+#ifndef CACHEARBITER_H
+#define CACHEARBITER_H
+
+// Shares one memory budget between several LRUCache instances. Each cache
+// gets a share of the budget in bytes, turned into an entry capacity with the
+// cache's measured bytes per entry (memory_usage()). Every rebalance compares
+// the caches' marginal hit value, the misses on recently evicted keys per byte
+// of extra capacity that would have caught them, and moves a slice of budget
+// from the cache where it is worth least to the one where it is worth most.
+// Each cache's ghost table follows its capacity as shares move, so the ghost
+// hits compared always cover the same fraction of every cache.
+// Shares always add up to the budget.
+//   CacheArbiter arbiter(size_t(1) << 30, std::chrono::seconds(10));
+//   arbiter.add("sessions", sessions);
+//   arbiter.add("thumbnails", thumbnails);
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include "threadSafe.h"
+
+class CacheArbiter {
+public:
+    // With a non-zero interval a background thread calls rebalance() periodically
+    explicit CacheArbiter(size_t budget_bytes, std::chrono::milliseconds interval = std::chrono::milliseconds(0))
+        : budget(budget_bytes), interval(interval) {
+        if (interval.count() > 0) {
+            worker = std::thread([this] { run(); });
+        }
+    }
+
+    ~CacheArbiter() {
+        {
+            std::lock_guard<std::mutex> lock(arbiter_mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    CacheArbiter(const CacheArbiter&) = delete;
+    CacheArbiter& operator=(const CacheArbiter&) = delete;
+
+    // Registers a cache under a name; it gets an equal share of the budget,
+    // taken proportionally from the caches already registered
+    template<typename KeyType, typename ValueType>
+    void add(const std::string& name, std::shared_ptr<LRUCache<KeyType, ValueType>> cache) {
+        std::lock_guard<std::mutex> lock(arbiter_mutex);
+        members.erase(name);
+        size_t given = 0;
+        for (auto& entry : members) {
+            entry.second.share = size_t(double(entry.second.share) * members.size() / (members.size() + 1));
+            given += entry.second.share;
+        }
+
+        Member member;
+        member.counters = [cache] { return cache->counters(); };
+        member.memory = [cache] { return cache->memory_usage(); };
+        member.resize = [cache](size_t capacity) { cache->resize(capacity); };
+        member.track_evicted = [cache](size_t entries) { cache->track_evicted(entries); };
+        member.share = budget - given;
+        member.entry_bytes = double(sizeof(std::pair<KeyType, ValueType>) + 64);  // Until measured
+        CacheCounters counters = cache->counters();
+        measure(member, counters);
+        member.last_ghost_hits = counters.ghost_hits;
+
+        Member& added = members.emplace(name, std::move(member)).first->second;
+        for (auto& entry : members) {
+            if (&entry.second != &added) {
+                apply_share(entry.second);  // Shrink the others first
+            }
+        }
+        apply_share(added);
+    }
+
+    // Unregisters a cache; its share is split proportionally among the rest
+    bool remove(const std::string& name) {
+        std::lock_guard<std::mutex> lock(arbiter_mutex);
+        auto it = members.find(name);
+        if (it == members.end()) {
+            return false;
+        }
+        members.erase(it);
+        size_t assigned = 0;
+        for (const auto& entry : members) {
+            assigned += entry.second.share;
+        }
+        size_t freed = budget - assigned;
+        size_t given = 0;
+        for (auto& entry : members) {
+            size_t extra = assigned ? size_t(double(freed) * entry.second.share / assigned) : freed / members.size();
+            entry.second.share += extra;
+            given += extra;
+        }
+        if (!members.empty()) {
+            members.begin()->second.share += freed - given;  // Rounding remainder
+        }
+        for (auto& entry : members) {
+            apply_share(entry.second);
+        }
+        return true;
+    }
+
+    // Function to move one slice of budget from the least to the most valuable cache
+    void rebalance() {
+        std::lock_guard<std::mutex> lock(arbiter_mutex);
+        if (members.size() < 2) {
+            return;
+        }
+        size_t min_share = budget / (members.size() * 16);  // Nobody is starved completely
+        Member* donor = nullptr;
+        Member* receiver = nullptr;
+        for (auto& entry : members) {
+            Member& member = entry.second;
+            CacheCounters counters = member.counters();
+            measure(member, counters);
+            // Hits per byte that ghost_entries more entries would have added this interval
+            member.value = double(counters.ghost_hits - member.last_ghost_hits)
+                           / (double(member.ghost_entries) * member.entry_bytes);
+            member.last_ghost_hits = counters.ghost_hits;
+            if (member.share > min_share && (donor == nullptr || member.value < donor->value)) {
+                donor = &member;
+            }
+            if (receiver == nullptr || member.value > receiver->value) {
+                receiver = &member;
+            }
+        }
+        if (donor == nullptr || donor == receiver || receiver->value <= donor->value) {
+            return;  // No cache would gain more than another loses
+        }
+        size_t step = std::min(budget / 32, donor->share - min_share);
+        donor->share -= step;
+        receiver->share += step;
+        apply_share(*donor);  // Shrink first so memory is freed before it's reused
+        apply_share(*receiver);
+    }
+
+    // Bytes of the budget currently assigned to a cache
+    size_t share(const std::string& name) {
+        std::lock_guard<std::mutex> lock(arbiter_mutex);
+        auto it = members.find(name);
+        return it == members.end() ? 0 : it->second.share;
+    }
+
+private:
+    static constexpr size_t min_ghost_entries = 256;
+    static constexpr size_t min_sample_entries = 16;  // Fewer entries give a noisy bytes-per-entry figure
+
+    struct Member {
+        std::function<CacheCounters()> counters;
+        std::function<MemoryUsage()> memory;
+        std::function<void(size_t)> resize;
+        std::function<void(size_t)> track_evicted;
+        size_t share;  // Bytes of the budget
+        double entry_bytes;  // Measured memory per entry
+        size_t ghost_entries = 0;  // Size of the cache's evicted-key table
+        uint64_t last_ghost_hits;
+        double value = 0;  // Marginal hits per byte over the last interval
+    };
+
+    void measure(Member& member, const CacheCounters& counters) {
+        if (counters.size >= min_sample_entries) {
+            member.entry_bytes = double(member.memory().total()) / counters.size;
+        }
+    }
+
+    static size_t capacity_of(const Member& member) {
+        return std::max<size_t>(1, size_t(member.share / member.entry_bytes));
+    }
+
+    // Resizes a member's cache to its share, with a ghost table a quarter of
+    // the new capacity
+    static void apply_share(Member& member) {
+        size_t capacity = capacity_of(member);
+        member.resize(capacity);
+        size_t ghost_entries = std::max<size_t>(min_ghost_entries, capacity / 4);
+        if (ghost_entries != member.ghost_entries) {
+            member.track_evicted(ghost_entries);
+            member.ghost_entries = ghost_entries;
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(arbiter_mutex);
+        while (!wakeup.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            rebalance();
+            lock.lock();
+        }
+    }
+
+    size_t budget;  // Bytes shared by all registered caches
+    std::chrono::milliseconds interval;
+    std::map<std::string, Member> members;
+    std::mutex arbiter_mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+    std::thread worker;  // Last, so it starts after the members above exist
+};
+
+#endif // CACHEARBITER_H
@@ -0,0 +1,178 @@
+// Loopback load generator for cacheServer: preloads a key space, then runs
+// pipelined get/set traffic from several connections and reports throughput.
+// Run it against `cacheServer` and `cacheServer --io-uring` to compare the
+// two front-ends.
+//
+// Build: g++ -std=c++17 -O2 -pthread cacheBench.cpp -o cacheBench
+// Usage: ./cacheBench [port] [connections] [seconds] [value bytes] [pipeline depth] [get percent]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+constexpr size_t key_space = 10000;
+
+// Blocking memcached client connection with just enough parsing to count replies
+class Client {
+public:
+    explicit Client(uint16_t port) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            throw std::runtime_error("Cannot connect to port " + std::to_string(port));
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    ~Client() {
+        ::close(fd);
+    }
+
+    void send_all(const std::string& data) {
+        for (size_t sent = 0; sent < data.size();) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                throw std::runtime_error("send failed");
+            }
+            sent += n;
+        }
+    }
+
+    // Reads one reply: a get ends with END, a set with a single status line
+    void read_reply() {
+        for (;;) {
+            std::string line = read_line();
+            if (line.compare(0, 6, "VALUE ") == 0) {
+                size_t bytes = std::stoul(line.substr(line.rfind(' ') + 1));
+                skip(bytes + 2);
+            } else if (line == "END" || line == "STORED" || line == "NOT_STORED") {
+                return;
+            } else {
+                throw std::runtime_error("Unexpected reply: " + line);
+            }
+        }
+    }
+
+private:
+    std::string read_line() {
+        for (;;) {
+            size_t nl = buffer.find('\n', pos);
+            if (nl != std::string::npos) {
+                std::string line = buffer.substr(pos, nl - pos);
+                pos = nl + 1;
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                return line;
+            }
+            fill();
+        }
+    }
+
+    // Discards bytes of value data, which may itself contain newlines
+    void skip(size_t bytes) {
+        while (buffer.size() - pos < bytes) {
+            fill();
+        }
+        pos += bytes;
+    }
+
+    void fill() {
+        if (pos > 0) {
+            buffer.erase(0, pos);
+            pos = 0;
+        }
+        char chunk[65536];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            throw std::runtime_error("Connection closed by server");
+        }
+        buffer.append(chunk, n);
+    }
+
+    int fd;
+    std::string buffer;
+    size_t pos = 0;
+};
+
+std::string set_request(size_t key, const std::string& value) {
+    return "set key:" + std::to_string(key) + " 0 0 " + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+}
+
+int main(int argc, char* argv[]) {
+    uint16_t port = argc > 1 ? uint16_t(std::stoi(argv[1])) : 11211;
+    size_t connections = argc > 2 ? std::stoul(argv[2]) : 4;
+    double seconds = argc > 3 ? std::stod(argv[3]) : 5;
+    size_t value_size = argc > 4 ? std::stoul(argv[4]) : 100;
+    size_t depth = argc > 5 ? std::stoul(argv[5]) : 16;
+    unsigned get_percent = argc > 6 ? unsigned(std::stoul(argv[6])) : 90;
+    const std::string value(value_size, 'x');
+
+    try {
+        Client loader(port);  // Preload so gets hit
+        for (size_t key = 0; key < key_space; ++key) {
+            loader.send_all(set_request(key, value));
+            loader.read_reply();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::atomic<uint64_t> total_ops{0};
+    std::atomic<bool> failed{false};
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < connections; ++c) {
+        threads.emplace_back([&, c] {
+            try {
+                Client client(port);
+                std::mt19937_64 rng(c);
+                std::string batch;
+                uint64_t ops = 0;
+                while (std::chrono::steady_clock::now() < deadline) {
+                    batch.clear();
+                    for (size_t i = 0; i < depth; ++i) {
+                        size_t key = rng() % key_space;
+                        if (rng() % 100 < get_percent) {
+                            batch += "get key:" + std::to_string(key) + "\r\n";
+                        } else {
+                            batch += set_request(key, value);
+                        }
+                    }
+                    client.send_all(batch);
+                    for (size_t i = 0; i < depth; ++i) {
+                        client.read_reply();
+                    }
+                    ops += depth;
+                }
+                total_ops += ops;
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                failed = true;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::cout << connections << " connections, " << value_size << " B values, depth " << depth << ", "
+              << get_percent << "% gets: " << uint64_t(total_ops / seconds) << " ops/s" << std::endl;
+    return failed ? 1 : 0;
+}
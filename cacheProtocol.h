@@ -0,0 +1,323 @@
+#ifndef CACHEPROTOCOL_H
+#define CACHEPROTOCOL_H
+
+// Memcached text protocol over sharded LRUCache instances, shared by the
+// epoll and io_uring front-ends of cacheServer.
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include "threadSafe.h"
+
+// Largest value accepted by set/add, same default as memcached
+constexpr size_t max_item_size = 1024 * 1024;
+// Longest command line accepted before the connection is dropped
+constexpr size_t max_line_size = 4096;
+
+// Stored items are immutable and reference counted, so a front-end can keep
+// sending straight out of one after it has been evicted or replaced
+typedef std::shared_ptr<const std::string> Item;
+
+// One cache partition; update_mutex makes add/incr/delete atomic w.r.t. writers
+struct Shard {
+    explicit Shard(size_t capacity) : cache(capacity) {}
+    LRUCache<std::string, Item> cache;
+    std::mutex update_mutex;
+};
+
+// Items carry the flags, CAS id and expiry time in a fixed binary prefix before the data
+struct ItemHeader {
+    uint32_t flags;
+    uint64_t cas;
+    int64_t expires;  // Unix time at which the item expires, 0 for never
+};
+constexpr size_t item_header_size = sizeof(uint32_t) + sizeof(uint64_t) + sizeof(int64_t);
+
+// exptime values above this are absolute Unix times, as in memcached
+constexpr int64_t max_relative_exptime = 60 * 60 * 24 * 30;
+
+inline Item encode_item(uint32_t flags, uint64_t cas, int64_t expires, std::string_view data) {
+    std::string item(item_header_size + data.size(), '\0');
+    std::memcpy(&item[0], &flags, sizeof(flags));
+    std::memcpy(&item[sizeof(flags)], &cas, sizeof(cas));
+    std::memcpy(&item[sizeof(flags) + sizeof(cas)], &expires, sizeof(expires));
+    std::memcpy(&item[item_header_size], data.data(), data.size());
+    return std::make_shared<const std::string>(std::move(item));
+}
+
+inline ItemHeader decode_header(const Item& item) {
+    ItemHeader header;
+    std::memcpy(&header.flags, item->data(), sizeof(header.flags));
+    std::memcpy(&header.cas, item->data() + sizeof(header.flags), sizeof(header.cas));
+    std::memcpy(&header.expires, item->data() + sizeof(header.flags) + sizeof(header.cas), sizeof(header.expires));
+    return header;
+}
+
+// Expiry time for a set/add exptime: 0 never expires, a negative exptime
+// has already expired, larger than 30 days is absolute, otherwise relative
+inline int64_t expiry_time(int64_t exptime, int64_t now) {
+    if (exptime == 0) {
+        return 0;
+    }
+    if (exptime < 0) {
+        return -1;
+    }
+    return exptime > max_relative_exptime ? exptime : now + exptime;
+}
+
+inline bool expired(int64_t expires, int64_t now) {
+    return expires != 0 && expires <= now;
+}
+
+// Looks up an unexpired item; expired ones are left for the LRU to evict,
+// since erasing here could race with a concurrent set of the same key
+inline bool find_item(Shard& shard, const std::string& key, Item& item, int64_t now) {
+    return shard.cache.try_get(key, item) && !expired(decode_header(item).expires, now);
+}
+
+inline std::string_view item_data(const Item& item) {
+    return std::string_view(*item).substr(item_header_size);
+}
+
+// All shards of the server; any reactor may touch any shard
+class CacheStore {
+public:
+    CacheStore(size_t shard_count, size_t capacity) {
+        for (size_t i = 0; i < shard_count; ++i) {
+            shards.emplace_back(new Shard(capacity));
+        }
+    }
+
+    Shard& shard_for(const std::string& key) {
+        return *shards[std::hash<std::string>()(key) % shards.size()];
+    }
+
+    uint64_t next_cas() {
+        return cas_counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+private:
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<uint64_t> cas_counter{0};
+};
+
+template<typename T>
+bool parse_number(std::string_view token, T& value) {
+    auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+    return result.ec == std::errc() && result.ptr == token.data() + token.size();
+}
+
+// Reply sink that copies everything into one output buffer, of which the
+// first sent bytes have already gone out
+struct StringReplies {
+    std::string& out;
+    size_t sent = 0;
+
+    // Bytes buffered and not yet sent
+    size_t pending() const {
+        return out.size() - sent;
+    }
+
+    void append(std::string_view text) {
+        out.append(text.data(), text.size());
+    }
+
+    void append_item(const Item& item) {
+        append(item_data(item));
+    }
+};
+
+// Appends "VALUE <key> <flags> <bytes>[ <cas>]\r\n<data>\r\n" for a stored item
+template<typename Replies>
+void append_value(Replies& out, std::string_view key, const Item& item, bool with_cas) {
+    ItemHeader header = decode_header(item);
+    std::string line = "VALUE ";
+    line += key;
+    line += ' ';
+    line += std::to_string(header.flags);
+    line += ' ';
+    line += std::to_string(item->size() - item_header_size);
+    if (with_cas) {
+        line += ' ';
+        line += std::to_string(header.cas);
+    }
+    line += "\r\n";
+    out.append(line);
+    out.append_item(item);
+    out.append("\r\n");
+}
+
+// Parses and executes every complete request in [data, data + len), appending
+// replies to out. Returns the number of bytes consumed; a trailing partial
+// request is left for the next read. Sets close on quit or a framing error.
+// Parsing stops once out.pending() reaches max_output, leaving the rest for a
+// call after the output has drained. A multi-key get can stop between keys:
+// resume_key then holds the number of keys already answered and the get's
+// line is left unconsumed, so the next call carries on from that key.
+template<typename Replies>
+size_t process_requests(CacheStore& store, const char* data, size_t len, Replies& out, bool& close,
+                        size_t max_output, size_t& resume_key) {
+    size_t pos = 0;
+    std::vector<std::string_view> tokens;
+    std::string key;
+    Item item;
+
+    while (pos < len && !close && out.pending() < max_output) {
+        const char* line_end = static_cast<const char*>(std::memchr(data + pos, '\n', len - pos));
+        if (line_end == nullptr) {
+            if (len - pos > max_line_size) {
+                out.append("CLIENT_ERROR line too long\r\n");
+                close = true;
+            }
+            break;  // Wait for the rest of the line
+        }
+        size_t next = line_end - data + 1;
+        std::string_view line(data + pos, line_end - (data + pos));
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+
+        tokens.clear();
+        for (size_t i = 0; i < line.size();) {
+            size_t end = line.find(' ', i);
+            if (end == std::string_view::npos) {
+                end = line.size();
+            }
+            if (end > i) {
+                tokens.push_back(line.substr(i, end - i));
+            }
+            i = end + 1;
+        }
+        if (tokens.empty()) {
+            out.append("ERROR\r\n");
+            pos = next;
+            continue;
+        }
+
+        std::string_view command = tokens[0];
+        bool noreply = tokens.size() > 1 && tokens.back() == "noreply";
+        size_t argc = tokens.size() - (noreply ? 1 : 0);
+
+        int64_t now = int64_t(std::time(nullptr));
+
+        if ((command == "get" || command == "gets") && tokens.size() < 2) {
+            out.append("ERROR\r\n");
+        } else if (command == "get" || command == "gets") {
+            size_t i = 1 + resume_key;
+            resume_key = 0;
+            for (; i < tokens.size(); ++i) {
+                if (out.pending() >= max_output) {
+                    break;
+                }
+                key.assign(tokens[i]);
+                if (find_item(store.shard_for(key), key, item, now)) {
+                    append_value(out, tokens[i], item, command == "gets");
+                }
+            }
+            if (i < tokens.size()) {
+                resume_key = i - 1;  // Output full mid-get: answer the remaining keys next time
+                break;
+            }
+            out.append("END\r\n");
+        } else if (command == "set" || command == "add") {
+            uint32_t flags;
+            int64_t exptime;
+            size_t bytes;
+            if (argc != 5 || !parse_number(tokens[2], flags) || !parse_number(tokens[3], exptime)
+                    || !parse_number(tokens[4], bytes)) {
+                out.append("CLIENT_ERROR bad command line format\r\n");
+                close = true;
+                break;
+            }
+            if (bytes > max_item_size) {
+                out.append("SERVER_ERROR object too large for cache\r\n");
+                close = true;
+                break;
+            }
+            if (len - next < bytes + 2) {
+                break;  // Data block not fully received yet
+            }
+            if (data[next + bytes] != '\r' || data[next + bytes + 1] != '\n') {
+                out.append("CLIENT_ERROR bad data chunk\r\n");
+                close = true;
+                break;
+            }
+
+            key.assign(tokens[1]);
+            Shard& shard = store.shard_for(key);
+            bool stored = true;
+            int64_t expires = expiry_time(exptime, now);
+            {
+                std::lock_guard<std::mutex> lock(shard.update_mutex);
+                if (command == "add" && find_item(shard, key, item, now)) {
+                    stored = false;
+                } else if (expired(expires, now)) {
+                    shard.cache.erase(key);  // Stored and expired at once: only the old value goes
+                } else {
+                    shard.cache.put(key, encode_item(flags, store.next_cas(), expires,
+                                                     std::string_view(data + next, bytes)));
+                }
+            }
+            if (!noreply) {
+                out.append(stored ? "STORED\r\n" : "NOT_STORED\r\n");
+            }
+            next += bytes + 2;
+        } else if (command == "delete") {
+            if (argc < 2 || argc > 3) {
+                out.append("CLIENT_ERROR bad command line format\r\n");
+            } else {
+                key.assign(tokens[1]);
+                Shard& shard = store.shard_for(key);
+                bool deleted;
+                {
+                    std::lock_guard<std::mutex> lock(shard.update_mutex);
+                    deleted = find_item(shard, key, item, now);  // An expired item is already gone
+                    shard.cache.erase(key);
+                }
+                if (!noreply) {
+                    out.append(deleted ? "DELETED\r\n" : "NOT_FOUND\r\n");
+                }
+            }
+        } else if (command == "incr" || command == "decr") {
+            uint64_t delta;
+            if (argc != 3 || !parse_number(tokens[2], delta)) {
+                out.append("CLIENT_ERROR invalid numeric delta argument\r\n");
+            } else {
+                key.assign(tokens[1]);
+                Shard& shard = store.shard_for(key);
+                std::string reply;
+                {
+                    std::lock_guard<std::mutex> lock(shard.update_mutex);
+                    uint64_t number;
+                    if (!find_item(shard, key, item, now)) {
+                        reply = "NOT_FOUND";
+                    } else if (!parse_number(item_data(item), number)) {
+                        reply = "CLIENT_ERROR cannot increment or decrement non-numeric value";
+                    } else {
+                        number = command == "incr" ? number + delta : (number > delta ? number - delta : 0);
+                        reply = std::to_string(number);
+                        ItemHeader header = decode_header(item);
+                        shard.cache.put(key, encode_item(header.flags, store.next_cas(), header.expires, reply));
+                    }
+                }
+                if (!noreply) {
+                    reply += "\r\n";
+                    out.append(reply);
+                }
+            }
+        } else if (command == "quit") {
+            close = true;
+        } else {
+            out.append("ERROR\r\n");
+        }
+        pos = next;
+    }
+    return pos;
+}
+
+#endif // CACHEPROTOCOL_H
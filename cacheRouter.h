@@ -0,0 +1,152 @@
+#ifndef CACHEROUTER_H
+#define CACHEROUTER_H
+
+// Client-side routing of keys over several caches with consistent hashing.
+// HashRing works with any node handle (an LRUCache, a "host:port" endpoint
+// string, ...); CacheRouter wraps it around in-process LRUCache instances.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include "threadSafe.h"
+
+// Consistent-hash ring mapping keys to named nodes. Each node owns
+// weight * vnodes_per_weight points on a 64-bit ring and a key belongs to the
+// first point clockwise of its hash, so adding or removing a node only moves
+// the keys on the arcs that node gains or loses.
+template<typename NodeType>
+class HashRing {
+public:
+    explicit HashRing(size_t vnodes_per_weight = 160) : vnodes_per_weight(vnodes_per_weight) {}
+
+    // Adds a node, or replaces the handle and weight of an existing name
+    void add(const std::string& name, const NodeType& node, size_t weight = 1) {
+        std::unique_lock<std::shared_mutex> lock(ring_mutex);
+        members[name] = Member{node, weight};
+        rebuild();
+    }
+
+    // Removes a node, returns whether it was present
+    bool remove(const std::string& name) {
+        std::unique_lock<std::shared_mutex> lock(ring_mutex);
+        if (members.erase(name) == 0) {
+            return false;
+        }
+        rebuild();
+        return true;
+    }
+
+    // Function to find the node owning a key hash
+    NodeType node_for(uint64_t hash) const {
+        std::shared_lock<std::shared_mutex> lock(ring_mutex);
+        if (points.empty()) {
+            throw std::range_error("Hash ring has no nodes");
+        }
+        auto it = std::lower_bound(points.begin(), points.end(), hash,
+                                   [](const Point& point, uint64_t h) { return point.hash < h; });
+        if (it == points.end()) {
+            it = points.begin();  // Wrap around the ring
+        }
+        return it->member->node;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(ring_mutex);
+        return members.size();
+    }
+
+    // 64-bit finalizer (splitmix64) so weak hashes like std::hash<int> spread over the ring
+    static uint64_t mix(uint64_t h) {
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+
+private:
+    struct Member {
+        NodeType node;
+        size_t weight;
+    };
+
+    struct Point {
+        uint64_t hash;
+        const Member* member;
+    };
+
+    static uint64_t hash_name(const std::string& name, size_t replica) {
+        uint64_t hash = 14695981039346656037ull;  // FNV-1a of "name#replica"
+        for (unsigned char c : name + '#' + std::to_string(replica)) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        return mix(hash);
+    }
+
+    // Points depend only on names and weights, so a node keeps its arcs across rebuilds
+    void rebuild() {
+        points.clear();
+        for (const auto& entry : members) {
+            size_t replicas = entry.second.weight * vnodes_per_weight;
+            for (size_t i = 0; i < replicas; ++i) {
+                points.push_back(Point{hash_name(entry.first, i), &entry.second});
+            }
+        }
+        std::sort(points.begin(), points.end(), [](const Point& a, const Point& b) { return a.hash < b.hash; });
+    }
+
+    size_t vnodes_per_weight;  // Ring points per unit of weight
+    std::map<std::string, Member> members;  // Node addresses stay stable for the points
+    std::vector<Point> points;  // Sorted by hash
+    mutable std::shared_mutex ring_mutex;  // Lookups share, membership changes are exclusive
+};
+
+// Routes get/put/erase over several LRUCache instances through a HashRing
+template<typename KeyType, typename ValueType>
+class CacheRouter {
+public:
+    typedef std::shared_ptr<LRUCache<KeyType, ValueType>> CachePtr;
+
+    explicit CacheRouter(size_t vnodes_per_weight = 160) : ring(vnodes_per_weight) {}
+
+    // Adds a cache under a name; weight scales its share of the key space
+    void add_node(const std::string& name, CachePtr cache, size_t weight = 1) {
+        ring.add(name, cache, weight);
+    }
+
+    // Removes a cache; its keys move to the neighbouring nodes and miss once
+    bool remove_node(const std::string& name) {
+        return ring.remove(name);
+    }
+
+    CachePtr cache_for(const KeyType& key) const {
+        return ring.node_for(HashRing<CachePtr>::mix(std::hash<KeyType>()(key)));
+    }
+
+    // Function to retrieve a value from the owning cache
+    ValueType get(const KeyType& key) {
+        return cache_for(key)->get(key);
+    }
+
+    bool try_get(const KeyType& key, ValueType& value) {
+        return cache_for(key)->try_get(key, value);
+    }
+
+    // Function to insert or update a value in the owning cache
+    void put(const KeyType& key, const ValueType& value) {
+        cache_for(key)->put(key, value);
+    }
+
+    bool erase(const KeyType& key) {
+        return cache_for(key)->erase(key);
+    }
+
+private:
+    HashRing<CachePtr> ring;
+};
+
+#endif // CACHEROUTER_H
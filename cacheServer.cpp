@@ -0,0 +1,748 @@
+// Memcached text-protocol server over sharded LRUCache instances.
+// One reactor per core accepts on its own SO_REUSEPORT socket, and keys are
+// partitioned across one LRUCache per reactor by hash (see cacheProtocol.h).
+// Reactors use epoll by default, or io_uring with --io-uring.
+//
+// Build: g++ -std=c++17 -O2 -pthread cacheServer.cpp -o cacheServer
+// Usage: ./cacheServer [--io-uring] [port] [reactors] [capacity per reactor]
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <system_error>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "cacheProtocol.h"
+
+// Opens a non-blocking loopback listener; SO_REUSEPORT lets every reactor
+// bind the same port and have the kernel spread connections across them
+int open_listener(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Single-threaded epoll event loop owning its listener and connections
+class EpollReactor {
+public:
+    EpollReactor(CacheStore& store, int listen_fd) : store(store), listen_fd(listen_fd) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;  // nullptr marks the listener
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    }
+
+    ~EpollReactor() {
+        for (auto& entry : connections) {
+            ::close(entry.first);
+        }
+        ::close(epoll_fd);
+        ::close(listen_fd);
+    }
+
+    void run() {
+        epoll_event events[256];
+        for (;;) {
+            int n = epoll_wait(epoll_fd, events, 256, -1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.ptr == nullptr) {
+                    accept_all();
+                } else {
+                    handle(static_cast<Connection*>(events[i].data.ptr), events[i].events);
+                }
+            }
+        }
+    }
+
+private:
+    // Parsing and reading pause while this much output is unsent, so slow
+    // readers cannot bloat memory; a reply may overshoot it by one value
+    static constexpr size_t max_pending_output = 4 * 1024 * 1024;
+
+    struct Connection {
+        int fd;
+        uint32_t events = 0;  // Interest currently registered with epoll
+        bool closing = false;  // Quit, framing or socket error: close once output is flushed
+        bool peer_eof = false;  // Peer finished sending; buffered requests are still answered
+        std::string in;
+        std::string out;
+        size_t out_pos = 0;
+        size_t resume_key = 0;  // Keys of a partly answered get at the front of in
+    };
+
+    void accept_all() {
+        for (;;) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;  // EAGAIN, or a transient error; retried on the next event
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            auto conn = std::make_unique<Connection>();
+            conn->fd = fd;
+            conn->events = EPOLLIN;
+            epoll_event event{};
+            event.events = conn->events;
+            event.data.ptr = conn.get();
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+            connections[fd] = std::move(conn);
+        }
+    }
+
+    void handle(Connection* conn, uint32_t events) {
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            char buffer[16384];
+            for (;;) {
+                ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    conn->in.append(buffer, n);
+                    continue;
+                }
+                if (n == 0) {
+                    conn->peer_eof = true;  // Half-close: answer what arrived, then close
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    conn->closing = true;  // Socket failed; flush what we can
+                }
+                if (n == 0 || errno != EINTR) {
+                    break;
+                }
+            }
+        }
+
+        // Complete requests are answered until the output budget is reached;
+        // the rest stay in in and are parsed again as the socket drains
+        bool stalled = false;
+        for (;;) {
+            size_t consumed = 0;
+            if (!conn->in.empty() && !conn->closing) {
+                bool close = false;  // Only quit or a framing error stops parsing
+                StringReplies replies{conn->out, conn->out_pos};
+                consumed = process_requests(store, conn->in.data(), conn->in.size(), replies, close,
+                                            max_pending_output, conn->resume_key);
+                conn->in.erase(0, consumed);
+                conn->closing = conn->closing || close;
+            }
+            if (!flush(conn)) {
+                close_connection(conn);
+                return;
+            }
+            stalled = consumed == 0 && conn->resume_key == 0;  // Partial request or nothing to do
+            if (conn->closing || conn->in.empty() || conn->out_pos != conn->out.size() || stalled) {
+                break;
+            }
+        }
+        // After EOF only a partial request can be left once the output is flushed
+        bool finished = conn->closing || (conn->peer_eof && (conn->in.empty() || stalled));
+        if (finished && conn->out_pos == conn->out.size()) {
+            close_connection(conn);
+            return;
+        }
+
+        // EPOLLIN stays off after EOF, where it would be reported on every wait
+        size_t pending = conn->out.size() - conn->out_pos;
+        bool reading = pending < max_pending_output && !conn->closing && !conn->peer_eof;
+        uint32_t wanted = (reading ? uint32_t(EPOLLIN) : 0u) | (pending ? uint32_t(EPOLLOUT) : 0u);
+        if (wanted != conn->events) {
+            conn->events = wanted;
+            epoll_event event{};
+            event.events = wanted;
+            event.data.ptr = conn;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        }
+    }
+
+    // Writes as much buffered output as the socket takes; false on a hard error
+    bool flush(Connection* conn) {
+        while (conn->out_pos < conn->out.size()) {
+            ssize_t n = send(conn->fd, conn->out.data() + conn->out_pos, conn->out.size() - conn->out_pos, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            conn->out_pos += n;
+        }
+        conn->out.clear();
+        conn->out_pos = 0;
+        return true;
+    }
+
+    void close_connection(Connection* conn) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+        ::close(conn->fd);
+        connections.erase(conn->fd);
+    }
+
+    CacheStore& store;
+    int listen_fd;
+    int epoll_fd;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+};
+
+// Single-threaded io_uring event loop: one multishot accept, one multishot
+// recv per connection fed from a registered provided-buffer ring, and sends
+// that reference large items in place (SEND_ZC when the kernel supports it).
+// All SQEs queued while draining completions go out in one io_uring_enter.
+class UringReactor {
+public:
+    UringReactor(CacheStore& store, int listen_fd) : store(store), listen_fd(listen_fd) {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        params.cq_entries = ring_entries * 4;
+        ring_fd = int(syscall(__NR_io_uring_setup, ring_entries, &params));
+        if (ring_fd < 0 && errno == EINVAL) {  // Pre-6.1 kernels lack the task-run flags
+            params = io_uring_params{};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = ring_entries * 4;
+            ring_fd = int(syscall(__NR_io_uring_setup, ring_entries, &params));
+        }
+        if (ring_fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+        }
+        map_rings(params);
+        setup_buffers();
+        zero_copy = probe_opcode(IORING_OP_SEND_ZC);
+        arm_accept();
+    }
+
+    ~UringReactor() {
+        for (auto& entry : connections) {
+            ::close(entry.first);
+        }
+        munmap(buffer_ring, buffer_count * sizeof(io_uring_buf));
+        munmap(sqes, sqe_map_size);
+        munmap(sq_ring, sq_map_size);
+        if (cq_ring != sq_ring) {
+            munmap(cq_ring, cq_map_size);
+        }
+        ::close(ring_fd);
+        ::close(listen_fd);
+    }
+
+    void run() {
+        for (;;) {
+            submit(1);
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                io_uring_cqe cqe = cqes[head & cq_mask];
+                __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                complete(cqe);
+            }
+        }
+    }
+
+private:
+    static constexpr unsigned ring_entries = 1024;
+    static constexpr unsigned buffer_count = 512;  // Power of two, as the buffer ring requires
+    static constexpr size_t buffer_size = 16384;
+    static constexpr uint16_t buffer_group = 0;
+    // Values at least this large are sent from the item itself, smaller ones are batched
+    static constexpr size_t zero_copy_threshold = 16384;
+    // While this much output is queued the connection's recv is cancelled and
+    // parsing pauses, as in EpollReactor; sends draining the queue resume both
+    static constexpr size_t max_pending_output = 4 * 1024 * 1024;
+
+    // Completion tags stored in the low bits of user_data
+    enum Tag : uint64_t { ACCEPT = 0, RECV = 1, SEND = 2, SEND_ZC = 3, CANCEL = 4 };
+
+    // Pending output: text is coalesced, large items are referenced in place
+    struct Chunk {
+        std::string text;
+        Item item;
+        size_t offset = 0;
+
+        const char* data() const {
+            return item ? item->data() + item_header_size : text.data();
+        }
+        size_t size() const {
+            return item ? item->size() - item_header_size : text.size();
+        }
+    };
+
+    struct alignas(8) Connection {
+        int fd;
+        bool closing = false;  // Quit, framing or socket error: stop parsing, close once flushed
+        bool peer_eof = false;  // Peer finished sending; buffered requests are still answered
+        bool recv_armed = false;
+        bool recv_cancelling = false;  // Cancel submitted because output is over the limit
+        bool send_in_flight = false;
+        bool shut_down = false;
+        unsigned notifications = 0;  // Zero-copy sends whose buffers the kernel still holds
+        std::string in;
+        std::deque<Chunk> out;
+        size_t pending = 0;  // Unsent bytes in out, items referenced in place included
+        size_t resume_key = 0;  // Keys of a partly answered get at the front of in
+    };
+
+    // Keeps an item alive until the kernel reports it no longer references it
+    struct ZeroCopySend {
+        Connection* conn;
+        Item item;
+    };
+
+    // Reply sink appending to a connection's chunk queue without touching
+    // the chunk currently handed to the kernel
+    struct ChunkReplies {
+        Connection& conn;
+
+        size_t pending() const {
+            return conn.pending;
+        }
+
+        void append(std::string_view text) {
+            bool back_busy = conn.send_in_flight && conn.out.size() == 1;
+            if (conn.out.empty() || conn.out.back().item || back_busy) {
+                conn.out.emplace_back();
+            }
+            conn.out.back().text.append(text.data(), text.size());
+            conn.pending += text.size();
+        }
+
+        void append_item(const Item& item) {
+            if (item->size() - item_header_size < zero_copy_threshold) {
+                append(item_data(item));
+                return;
+            }
+            conn.out.emplace_back();
+            conn.out.back().item = item;
+            conn.pending += item->size() - item_header_size;
+        }
+    };
+
+    void map_rings(const io_uring_params& params) {
+        sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_map) {
+            sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+        }
+        sq_ring = map(sq_map_size, IORING_OFF_SQ_RING);
+        cq_ring = single_map ? sq_ring : map(cq_map_size, IORING_OFF_CQ_RING);
+        sqe_map_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(map(sqe_map_size, IORING_OFF_SQES));
+
+        char* sq = static_cast<char*>(sq_ring);
+        char* cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries = params.sq_entries;
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // SQ slots map 1:1 to SQEs, so the indirection array is filled once
+        unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries; ++i) {
+            array[i] = i;
+        }
+        sqe_tail = *sq_tail;
+    }
+
+    void* map(size_t size, off_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+        if (ptr == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "io_uring mmap");
+        }
+        return ptr;
+    }
+
+    // Registers a provided-buffer ring so multishot recv picks its own buffers
+    void setup_buffers() {
+        void* ring = mmap(nullptr, buffer_count * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (ring == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "buffer ring mmap");
+        }
+        buffer_ring = static_cast<io_uring_buf_ring*>(ring);
+        buffers.resize(buffer_count * buffer_size);
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(buffer_ring);
+        reg.ring_entries = buffer_count;
+        reg.bgid = buffer_group;
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            throw std::system_error(errno, std::generic_category(), "IORING_REGISTER_PBUF_RING");
+        }
+        for (unsigned i = 0; i < buffer_count; ++i) {
+            recycle_buffer(uint16_t(i));
+        }
+    }
+
+    // Hands a provided buffer back to the kernel. The ring is indexed as a
+    // plain array: in C++ the header's flex-array member is not at offset 0
+    void recycle_buffer(uint16_t id) {
+        io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(buffer_ring) + (buffer_tail & (buffer_count - 1));
+        buf->addr = reinterpret_cast<uint64_t>(&buffers[id * buffer_size]);
+        buf->len = buffer_size;
+        buf->bid = id;
+        ++buffer_tail;
+        __atomic_store_n(&buffer_ring->tail, buffer_tail, __ATOMIC_RELEASE);
+    }
+
+    bool probe_opcode(uint8_t opcode) {
+        std::vector<char> storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+            return false;
+        }
+        return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    io_uring_sqe* get_sqe() {
+        while (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+            submit(0);  // SQ full: flush what is queued so far
+        }
+        io_uring_sqe* sqe = &sqes[sqe_tail & sq_mask];
+        ++sqe_tail;
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // Publishes queued SQEs and optionally waits for completions, in one syscall
+    void submit(unsigned wait) {
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+        unsigned pending = sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (pending == 0 && wait == 0) {
+            return;
+        }
+        unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+        if (syscall(__NR_io_uring_enter, ring_fd, pending, wait, flags, nullptr, 0) < 0
+                && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        }
+    }
+
+    static uint64_t tagged(void* ptr, Tag tag) {
+        return reinterpret_cast<uint64_t>(ptr) | tag;
+    }
+
+    void arm_accept() {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = tagged(nullptr, ACCEPT);
+    }
+
+    void arm_recv(Connection* conn) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = conn->fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = buffer_group;
+        sqe->user_data = tagged(conn, RECV);
+        conn->recv_armed = true;
+        conn->recv_cancelling = false;
+    }
+
+    // Stops a connection's multishot recv; it completes with -ECANCELED
+    void cancel_recv(Connection* conn) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = tagged(conn, RECV);
+        sqe->user_data = tagged(nullptr, CANCEL);
+        conn->recv_cancelling = true;
+    }
+
+    static bool output_full(const Connection* conn) {
+        return conn->pending >= max_pending_output;
+    }
+
+    // Answers the complete requests in a connection's input, up to the output
+    // limit. Peer EOF doesn't stop parsing; only quit or a framing error does
+    void parse_input(Connection* conn) {
+        if (conn->closing || conn->in.empty() || output_full(conn)) {
+            return;
+        }
+        bool close = false;
+        ChunkReplies replies{*conn};
+        size_t consumed = process_requests(store, conn->in.data(), conn->in.size(), replies, close,
+                                           max_pending_output, conn->resume_key);
+        conn->in.erase(0, consumed);
+        conn->closing = close;
+    }
+
+    // Starts sending the oldest pending chunk; one send per connection at a time keeps replies ordered
+    void start_send(Connection* conn) {
+        if (conn->send_in_flight || conn->out.empty() || conn->shut_down) {
+            return;
+        }
+        Chunk& chunk = conn->out.front();
+        io_uring_sqe* sqe = get_sqe();
+        sqe->fd = conn->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(chunk.data() + chunk.offset);
+        sqe->len = unsigned(chunk.size() - chunk.offset);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        if (chunk.item && zero_copy) {
+            sqe->opcode = IORING_OP_SEND_ZC;
+            sqe->user_data = tagged(new ZeroCopySend{conn, chunk.item}, SEND_ZC);
+        } else {
+            sqe->opcode = IORING_OP_SEND;
+            sqe->user_data = tagged(conn, SEND);
+        }
+        conn->send_in_flight = true;
+    }
+
+    void complete(const io_uring_cqe& cqe) {
+        void* ptr = reinterpret_cast<void*>(cqe.user_data & ~uint64_t(7));
+        switch (Tag(cqe.user_data & 7)) {
+        case ACCEPT:
+            on_accept(cqe);
+            break;
+        case RECV:
+            on_recv(static_cast<Connection*>(ptr), cqe);
+            break;
+        case SEND:
+            on_send(static_cast<Connection*>(ptr), cqe.res);
+            break;
+        case CANCEL:
+            break;  // The cancelled recv reports itself
+        case SEND_ZC: {
+            ZeroCopySend* send = static_cast<ZeroCopySend*>(ptr);
+            Connection* conn = send->conn;
+            if (cqe.flags & IORING_CQE_F_NOTIF) {
+                --conn->notifications;  // Kernel is done with the item's memory
+                delete send;
+                maybe_release(conn);
+                break;
+            }
+            if (cqe.flags & IORING_CQE_F_MORE) {
+                ++conn->notifications;  // A notification follows; keep the item until then
+            } else {
+                delete send;
+            }
+            on_send(conn, cqe.res);
+            break;
+        }
+        }
+    }
+
+    void on_accept(const io_uring_cqe& cqe) {
+        if (cqe.res >= 0) {
+            int one = 1;
+            setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            auto conn = std::make_unique<Connection>();
+            conn->fd = cqe.res;
+            arm_recv(conn.get());
+            connections[cqe.res] = std::move(conn);
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            arm_accept();  // Multishot accept ended (e.g. on an error); re-arm
+        }
+    }
+
+    void on_recv(Connection* conn, const io_uring_cqe& cqe) {
+        if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+            uint16_t id = uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            const char* data = &buffers[id * buffer_size];
+            size_t len = size_t(cqe.res);
+            if (!conn->closing) {
+                // Parse straight out of the provided buffer when nothing is carried over
+                if (conn->in.empty() && !output_full(conn)) {
+                    bool close = false;
+                    ChunkReplies replies{*conn};
+                    size_t consumed = process_requests(store, data, len, replies, close,
+                                                       max_pending_output, conn->resume_key);
+                    conn->in.assign(data + consumed, len - consumed);
+                    conn->closing = close;
+                } else {
+                    conn->in.append(data, len);  // Kept, if output is full, until sends drain it
+                    parse_input(conn);
+                }
+            }
+            recycle_buffer(id);
+        }
+
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            conn->recv_armed = false;
+            conn->recv_cancelling = false;
+            if (cqe.res == -ECANCELED) {
+                if (!conn->closing && !output_full(conn)) {
+                    arm_recv(conn);  // The queue drained before the cancel landed
+                }
+            } else if (cqe.res == -ENOBUFS && !conn->closing) {
+                if (!output_full(conn)) {
+                    arm_recv(conn);  // Ran out of provided buffers; they are recycled by now
+                }
+            } else if (cqe.res == 0) {
+                conn->peer_eof = true;  // Half-close: answer what arrived, then close
+            } else if (cqe.res < 0) {
+                conn->closing = true;  // The socket failed
+            } else if (!conn->closing && !output_full(conn)) {
+                arm_recv(conn);
+            }
+        } else if (output_full(conn) && !conn->recv_cancelling) {
+            cancel_recv(conn);
+        }
+
+        start_send(conn);
+        maybe_release(conn);
+    }
+
+    void on_send(Connection* conn, int res) {
+        conn->send_in_flight = false;
+        if (res < 0) {
+            conn->closing = true;
+            conn->out.clear();
+            conn->pending = 0;
+        } else {
+            Chunk& chunk = conn->out.front();
+            chunk.offset += size_t(res);
+            conn->pending -= size_t(res);
+            if (chunk.offset == chunk.size()) {
+                conn->out.pop_front();
+            }
+            parse_input(conn);  // Resumes requests held back by the output limit
+            if (!conn->recv_armed && !conn->closing && !conn->peer_eof && !output_full(conn)) {
+                arm_recv(conn);
+            }
+        }
+        start_send(conn);
+        maybe_release(conn);
+    }
+
+    // Shuts a closing connection down once its replies are flushed, and frees
+    // it after the kernel has dropped every reference to it
+    void maybe_release(Connection* conn) {
+        if (conn->send_in_flight || !conn->out.empty()) {
+            return;
+        }
+        // Input is parsed whenever output drains, so after EOF with nothing
+        // queued only a partial request can be left
+        if (conn->peer_eof) {
+            conn->closing = true;
+        }
+        if (!conn->closing) {
+            return;
+        }
+        if (!conn->shut_down) {
+            shutdown(conn->fd, SHUT_RDWR);  // Terminates the multishot recv
+            conn->shut_down = true;
+        }
+        if (conn->recv_armed || conn->notifications > 0) {
+            return;
+        }
+        ::close(conn->fd);
+        connections.erase(conn->fd);
+    }
+
+    CacheStore& store;
+    int listen_fd;
+    int ring_fd;
+    bool zero_copy = false;
+    // Submission and completion rings shared with the kernel
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    size_t sq_map_size = 0;
+    size_t cq_map_size = 0;
+    size_t sqe_map_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned sqe_tail = 0;  // Local tail, published to the kernel in submit()
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+    // Provided receive buffers
+    io_uring_buf_ring* buffer_ring = nullptr;
+    uint16_t buffer_tail = 0;
+    std::vector<char> buffers;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+};
+
+int main(int argc, char* argv[]) {
+    bool use_uring = argc > 1 && std::string(argv[1]) == "--io-uring";
+    if (use_uring) {
+        --argc;
+        ++argv;
+    }
+    uint16_t port = argc > 1 ? uint16_t(std::stoi(argv[1])) : 11211;
+    size_t reactors = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+    size_t capacity = argc > 3 ? std::stoul(argv[3]) : 100000;
+    std::signal(SIGPIPE, SIG_IGN);
+
+    CacheStore store(reactors, capacity);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < reactors; ++i) {
+        int listen_fd = open_listener(port);
+        if (listen_fd < 0) {
+            std::cerr << "Cannot listen on port " << port << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        threads.emplace_back([&store, listen_fd, i, use_uring] {
+            cpu_set_t cpus;  // One reactor per core; pinning is best effort
+            CPU_ZERO(&cpus);
+            CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+            try {
+                if (use_uring) {
+                    UringReactor reactor(store, listen_fd);
+                    reactor.run();
+                } else {
+                    EpollReactor reactor(store, listen_fd);
+                    reactor.run();
+                }
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                std::exit(1);
+            }
+        });
+    }
+
+    std::cout << "Serving " << reactors << " x " << capacity << " entries on 127.0.0.1:" << port
+              << (use_uring ? " (io_uring)" : " (epoll)") << std::endl;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return 0;
+}
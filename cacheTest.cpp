@@ -0,0 +1,707 @@
+// Self-checking tests. Each cache runs a random workload side by side with a
+// reference model and every result is compared: an exact LRU model for the
+// LRU caches, and for the other policies a model of what a hit must return
+// (the last value put) and how many entries may be resident. Resizes to
+// smaller and larger capacities and capacity 0 are part of every workload.
+// Given the path of a built cacheServer, both of its front-ends are started
+// and checked over loopback too, pipelined requests followed by a half-close
+// included. Exits non-zero if any check fails.
+//
+// Build: g++ -std=c++17 -O2 -pthread cacheTest.cpp -o cacheTest
+// Usage: ./cacheTest [path to cacheServer]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "threadSafe.h"
+#include "slabCache.h"
+#include "sharedCache.h"
+#include "cacheArbiter.h"
+
+static size_t failures = 0;
+
+// Records a failed check; only the first few are printed
+static void check(bool ok, const std::string& what) {
+    if (!ok && ++failures <= 20) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+}
+
+// Reference LRU: a list in recency order and a map into it
+template<typename KeyType, typename ValueType>
+class ReferenceLRU {
+public:
+    explicit ReferenceLRU(size_t capacity) : capacity(capacity) {}
+
+    bool get(const KeyType& key, ValueType& value) {
+        auto it = index.find(key);
+        if (it == index.end()) {
+            return false;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        value = it->second->second;
+        return true;
+    }
+
+    void put(const KeyType& key, const ValueType& value) {
+        erase(key);
+        if (capacity == 0) {
+            return;
+        }
+        if (entries.size() == capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(key, value);
+        index[key] = entries.begin();
+    }
+
+    bool erase(const KeyType& key) {
+        auto it = index.find(key);
+        if (it == index.end()) {
+            return false;
+        }
+        entries.erase(it->second);
+        index.erase(it);
+        return true;
+    }
+
+    void resize(size_t new_capacity) {
+        while (entries.size() > new_capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+        capacity = new_capacity;
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+private:
+    size_t capacity;
+    std::list<std::pair<KeyType, ValueType>> entries;
+    std::map<KeyType, typename std::list<std::pair<KeyType, ValueType>>::iterator> index;
+};
+
+// Capacities a workload cycles through: shrinking, growing and 0
+static const size_t capacities[] = {64, 17, 0, 128, 1, 40};
+
+// Runs ops random get/put/erase/resize calls on a cache and the reference
+// LRU, comparing every result. Cache supplies try_get/put/erase/resize and
+// size(), which returns SIZE_MAX for caches that can't report one.
+template<typename Cache>
+void check_exact_lru(const std::string& name, Cache& cache, uint32_t seed, size_t ops = 60000, int keys = 200,
+                     bool resizable = true) {
+    ReferenceLRU<int, int> model(capacities[0]);
+    std::mt19937 rng(seed);
+    size_t phase = 0;
+    for (size_t i = 0; i < ops; ++i) {
+        int key = int(rng() % keys);
+        unsigned op = rng() % 10;
+        if (op < 4) {
+            int expected = 0;
+            int value = 0;
+            bool hit = model.get(key, expected);
+            bool got = cache.try_get(key, value);
+            check(hit == got && (!hit || value == expected), name + ": get " + std::to_string(key) + " at op " + std::to_string(i));
+        } else if (op < 8) {
+            model.put(key, int(i));
+            cache.put(key, int(i));
+        } else {
+            check(model.erase(key) == cache.erase(key), name + ": erase " + std::to_string(key));
+        }
+        if (resizable && i % 5000 == 4999) {
+            size_t capacity = capacities[++phase % (sizeof(capacities) / sizeof(capacities[0]))];
+            model.resize(capacity);
+            cache.resize(capacity);
+        }
+        if (i % 1000 == 0 && cache.size() != SIZE_MAX) {
+            check(cache.size() == model.size(), name + ": size " + std::to_string(cache.size()) + " expected "
+                  + std::to_string(model.size()));
+        }
+    }
+}
+
+// Same workload for a policy without an exact model: a hit must return the
+// last value put for the key, erased keys must miss, and a scan of the key
+// space may find at most capacity entries
+template<typename Cache>
+void check_contents(const std::string& name, Cache& cache, uint32_t seed, size_t ops = 60000, int keys = 200) {
+    std::map<int, int> latest;  // Last value put, for keys not erased since
+    std::mt19937 rng(seed);
+    size_t capacity = capacities[0];
+    size_t phase = 0;
+    for (size_t i = 0; i < ops; ++i) {
+        int key = int(rng() % keys);
+        unsigned op = rng() % 10;
+        if (op < 4) {
+            int value = 0;
+            if (cache.try_get(key, value)) {
+                auto it = latest.find(key);
+                check(it != latest.end() && it->second == value, name + ": stale or erased value for " + std::to_string(key));
+            }
+        } else if (op < 8) {
+            latest[key] = int(i);
+            cache.put(key, int(i));
+            int value = 0;
+            if (capacity > 0) {
+                check(cache.try_get(key, value) && value == int(i), name + ": miss right after put");
+            }
+        } else {
+            latest.erase(key);
+            cache.erase(key);
+            int value = 0;
+            check(!cache.try_get(key, value), name + ": hit after erase");
+        }
+        if (i % 5000 == 4999) {
+            capacity = capacities[++phase % (sizeof(capacities) / sizeof(capacities[0]))];
+            cache.resize(capacity);
+        }
+        if (i % 2500 == 0) {
+            size_t resident = 0;
+            for (int k = 0; k < keys; ++k) {
+                int value = 0;
+                resident += cache.try_get(k, value);
+            }
+            check(resident <= capacity, name + ": " + std::to_string(resident) + " entries resident, capacity "
+                  + std::to_string(capacity));
+        }
+    }
+}
+
+// Adapters giving every cache the try_get/put/erase/resize/size shape above
+template<typename Cache>
+struct CountedAdapter {
+    Cache& cache;
+    bool try_get(int key, int& value) { return cache.try_get(key, value); }
+    void put(int key, int value) { cache.put(key, value); }
+    bool erase(int key) { return cache.erase(key); }
+    void resize(size_t capacity) { cache.resize(capacity); }
+    size_t size() { return cache.counters().size; }
+};
+
+template<typename Cache>
+struct ThrowingAdapter {
+    Cache& cache;
+    bool try_get(int key, int& value) {
+        try {
+            value = cache.get(key);
+            return true;
+        } catch (const std::range_error&) {
+            return false;
+        }
+    }
+    void put(int key, int value) { cache.put(key, value); }
+    void erase(int key) { cache.erase(key); }
+    void resize(size_t capacity) { cache.resize(capacity); }
+};
+
+struct SessionAdapter {
+    LRUCache<int, int>& cache;
+    CacheSession<int, int> session;
+    bool try_get(int key, int& value) { return session.try_get(key, value); }
+    void put(int key, int value) { session.put(key, value); }
+    bool erase(int key) { return session.erase(key); }
+    void resize(size_t capacity) { cache.resize(capacity); }
+    size_t size() { return cache.counters().size; }
+};
+
+struct PriorityAdapter {
+    PriorityLRUCache<int, int>& cache;
+    bool try_get(int key, int& value) { return cache.try_get(key, value); }
+    void put(int key, int value) { cache.put(key, value); }
+    bool erase(int key) { return cache.erase(key); }
+    void resize(size_t capacity) { cache.resize(capacity); }
+    size_t size() { return cache.size(Priority::BULK) + cache.size(Priority::NORMAL) + cache.size(Priority::CRITICAL); }
+};
+
+struct TenantAdapter {
+    TenantLRUCache<int, int, int>& cache;
+    bool try_get(int key, int& value) { return cache.try_get(7, key, value); }
+    void put(int key, int value) { cache.put(7, key, value); }
+    bool erase(int key) { return cache.erase(7, key); }
+    void resize(size_t capacity) { cache.resize(capacity); }
+    size_t size() { return cache.stats(7).size; }
+};
+
+struct HeterogeneousAdapter {
+    HeterogeneousLRUCache<int>& cache;
+    bool try_get(int key, int& value) { return cache.try_get(key, value); }
+    void put(int key, int value) { cache.put(key, int(value)); }
+    bool erase(int key) { return cache.erase(key); }
+    void resize(size_t capacity) { cache.resize(capacity); }
+    size_t size() { return cache.total_weight(); }
+};
+
+struct SoftAdapter {
+    SoftLRUCache<int, int>& cache;
+    std::map<int, std::shared_ptr<int>> held;  // Keeps weak entries alive, as outside owners would
+    bool try_get(int key, int& value) {
+        std::shared_ptr<int> pointer;
+        if (!cache.try_get(key, pointer)) {
+            return false;
+        }
+        value = *pointer;
+        return true;
+    }
+    void put(int key, int value) {
+        auto pointer = std::make_shared<int>(value);
+        held[key] = pointer;
+        cache.put(key, pointer);
+    }
+    bool erase(int key) { return cache.erase(key); }
+    void resize(size_t capacity) { cache.resize(capacity); }
+};
+
+// Values for the string caches: the key's number, padded to a size picked by the key
+static std::string string_value(int key, size_t version, size_t bytes) {
+    std::string value = std::to_string(key) + ":" + std::to_string(version) + ":";
+    value.resize(std::max(value.size(), bytes), char('a' + key % 26));
+    return value;
+}
+
+struct SharedAdapter {
+    SharedLRUCache& cache;
+    bool try_get(int key, int& value) {
+        std::string data;
+        if (!cache.try_get(std::to_string(key), data)) {
+            return false;
+        }
+        value = std::stoi(data.substr(data.find(':') + 1));
+        check(data == string_value(key, size_t(value), 20 + key % 40), "SharedLRUCache: value bytes");
+        return true;
+    }
+    void put(int key, int value) { cache.put(std::to_string(key), string_value(key, size_t(value), 20 + key % 40)); }
+    bool erase(int key) { return cache.erase(std::to_string(key)); }
+    void resize(size_t capacity) { cache.resize(capacity); }
+    size_t size() { return SIZE_MAX; }
+};
+
+struct DenseAdapter {
+    LRUCache<DenseKeys<int, 4096>, int>& cache;
+    bool try_get(int key, int& value) { return cache.try_get(key, value); }
+    void put(int key, int value) { cache.put(key, value); }
+    bool erase(int key) { return cache.erase(key); }
+    void resize(size_t capacity) { cache.resize(capacity); }
+    size_t size() { return SIZE_MAX; }
+};
+
+void test_incremental_hash_map() {
+    // Lookups must find every key while doublings migrate buckets a few at a time
+    IncrementalHashMap<int, int> map;
+    std::unordered_map<int, int> model;
+    std::mt19937 rng(11);
+    for (int i = 0; i < 200000; ++i) {
+        int key = int(rng() % 100000);
+        if (rng() % 4) {
+            map[key] = i;
+            model[key] = i;
+        } else {
+            check(map.erase(key) == model.erase(key), "IncrementalHashMap: erase");
+        }
+        if ((i & (i - 1)) == 0 || i % 9973 == 0) {  // Often while a migration is in progress
+            for (const auto& entry : model) {
+                auto it = map.find(entry.first);
+                check(it != map.end() && it->second == entry.second, "IncrementalHashMap: lost key during migration");
+            }
+            check(map.size() == model.size(), "IncrementalHashMap: size");
+        }
+        if (i % 1000 == 0) {
+            check(map.find(-1 - i) == map.end(), "IncrementalHashMap: phantom key");
+        }
+    }
+
+    // Detached nodes can be reinserted under another key
+    IncrementalHashMap<std::string, int> strings;
+    for (int i = 0; i < 1000; ++i) {
+        strings[std::to_string(i)] = i;
+    }
+    for (int i = 0; i < 1000; ++i) {
+        auto* node = strings.detach(strings.find(std::to_string(i)));
+        node->first = "moved" + std::to_string(i);
+        node->hash = strings.hash_key(node->first);
+        strings.insert_node(node);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        auto it = strings.find("moved" + std::to_string(i));
+        check(it != strings.end() && it->second == i && strings.find(std::to_string(i)) == strings.end(),
+              "IncrementalHashMap: detach and insert_node");
+    }
+}
+
+void test_lru_caches() {
+    {
+        LRUCache<int, int> cache(capacities[0]);
+        CountedAdapter<LRUCache<int, int>> adapter{cache};
+        check_exact_lru("LRUCache", adapter, 1);
+    }
+    {
+        auto reclaimer = std::make_shared<Reclaimer>();
+        std::pmr::synchronized_pool_resource pool;
+        LRUCache<int, int> cache(capacities[0], &pool, reclaimer);
+        CountedAdapter<LRUCache<int, int>> adapter{cache};
+        check_exact_lru("LRUCache with resource and reclaimer", adapter, 2);
+    }
+    {
+        LRUCache<int, int> cache(capacities[0]);
+        SessionAdapter adapter{cache, cache.session()};
+        check_exact_lru("CacheSession", adapter, 3);
+    }
+    {
+        LRUCache<int, int> cache(capacities[0], std::make_shared<Reclaimer>());
+        SessionAdapter adapter{cache, cache.session()};
+        check_exact_lru("CacheSession with reclaimer", adapter, 4);
+    }
+    {
+        LRUCache<DenseKeys<int, 4096>, int> cache(capacities[0]);
+        DenseAdapter adapter{cache};
+        check_exact_lru("DenseKeys LRUCache", adapter, 5);
+    }
+    {
+        FixedLRUCache<int, int, 64> cache;
+        struct Adapter {
+            FixedLRUCache<int, int, 64>& cache;
+            bool try_get(int key, int& value) { return cache.try_get(key, value); }
+            void put(int key, int value) { cache.put(key, value); }
+            bool erase(int key) { return cache.erase(key); }
+            void resize(size_t) {}
+            size_t size() { return cache.size(); }
+        } adapter{cache};
+        check_exact_lru("FixedLRUCache", adapter, 6, 60000, 200, false);
+    }
+    {
+        PriorityLRUCache<int, int> cache(capacities[0]);
+        PriorityAdapter adapter{cache};
+        check_exact_lru("PriorityLRUCache", adapter, 7);
+    }
+    {
+        TenantLRUCache<int, int, int> cache(capacities[0]);
+        TenantAdapter adapter{cache};
+        check_exact_lru("TenantLRUCache", adapter, 8);
+    }
+    {
+        HeterogeneousLRUCache<int> cache(capacities[0]);
+        HeterogeneousAdapter adapter{cache};
+        check_exact_lru("HeterogeneousLRUCache", adapter, 9);
+    }
+    {
+        SharedLRUCache cache(capacities[3], 64);  // Resizes can't exceed the segment's nodes
+        cache.resize(capacities[0]);
+        SharedAdapter adapter{cache};
+        check_exact_lru("SharedLRUCache", adapter, 10);
+    }
+}
+
+void test_other_policies() {
+    {
+        LFUCache<int, int> cache(capacities[0]);
+        ThrowingAdapter<LFUCache<int, int>> adapter{cache};
+        check_contents("LFUCache", adapter, 21);
+    }
+    {
+        LFUCache<int, int> cache(capacities[0], 100);
+        ThrowingAdapter<LFUCache<int, int>> adapter{cache};
+        check_contents("LFUCache with aging", adapter, 22);
+    }
+    {
+        LIRSCache<int, int> cache(capacities[0]);
+        ThrowingAdapter<LIRSCache<int, int>> adapter{cache};
+        check_contents("LIRSCache", adapter, 23);
+    }
+    {
+        LRUKCache<int, int> cache(capacities[0]);
+        ThrowingAdapter<LRUKCache<int, int>> adapter{cache};
+        check_contents("LRUKCache", adapter, 24);
+    }
+    {
+        WindowLRUCache<int, int> cache(capacities[0]);
+        ThrowingAdapter<WindowLRUCache<int, int>> adapter{cache};
+        check_contents("WindowLRUCache", adapter, 25);
+    }
+    {
+        SoftLRUCache<int, int> cache(capacities[0], capacities[0]);
+        SoftAdapter adapter{cache, {}};
+        check_contents("SoftLRUCache", adapter, 26);
+    }
+    {
+        // Weak entries don't count against the strong size but do against the capacity
+        SoftLRUCache<int, int> cache(capacities[0], 8);
+        SoftAdapter adapter{cache, {}};
+        check_contents("SoftLRUCache with weak entries", adapter, 27);
+    }
+}
+
+void test_slab_cache() {
+    SlabLRUCache cache(size_t(16) << 16, size_t(1) << 16);  // 16 pages of 64 KB
+    std::map<std::string, std::string> latest;
+    std::mt19937 rng(31);
+    for (size_t i = 0; i < 100000; ++i) {
+        std::string key = "k" + std::to_string(rng() % 3000);
+        unsigned op = rng() % 10;
+        std::string value;
+        if (op < 4) {
+            if (cache.try_get(key, value)) {
+                auto it = latest.find(key);
+                check(it != latest.end() && it->second == value, "SlabLRUCache: stale or erased value");
+            }
+        } else if (op < 8) {
+            size_t bytes = i < 50000 ? 10 + rng() % 100 : 500 + rng() % 3000;  // Shifts demand between classes
+            latest[key] = string_value(int(i % 1000), i, bytes);
+            cache.put(key, latest[key]);
+        } else {
+            latest.erase(key);
+            cache.erase(key);
+            check(!cache.try_get(key, value), "SlabLRUCache: hit after erase");
+        }
+        if (i % 5000 == 0) {
+            cache.compact();
+            size_t items = 0;
+            for (const SlabClassStats& c : cache.stats()) {
+                items += c.items;
+            }
+            check(items == cache.size(), "SlabLRUCache: class item counts");
+        }
+    }
+    size_t large_pages = 0;
+    for (const SlabClassStats& c : cache.stats()) {
+        large_pages += c.chunk_size >= 1024 ? c.pages : 0;
+    }
+    check(large_pages > 0, "SlabLRUCache: rebalancing moved no page to the classes now in demand");
+}
+
+void test_capacity_zero() {
+    int value = 0;
+    LRUCache<int, int> lru(0);
+    lru.put(1, 1);
+    check(!lru.try_get(1, value), "LRUCache(0) stored an entry");
+    auto session = lru.session();
+    session.put(2, 2);
+    check(!session.try_get(2, value), "CacheSession on LRUCache(0) stored an entry");
+    LRUCache<DenseKeys<int, 64>, int> dense(0);
+    dense.put(1, 1);
+    check(!dense.try_get(1, value), "DenseKeys LRUCache(0) stored an entry");
+    SoftLRUCache<int, int> soft(0);
+    soft.put(1, std::make_shared<int>(1));
+    check(soft.size() == 0, "SoftLRUCache(0) stored an entry");
+    PriorityLRUCache<int, int> priority(0);
+    priority.put(1, 1);
+    check(!priority.try_get(1, value), "PriorityLRUCache(0) stored an entry");
+    TenantLRUCache<int, int, int> tenants(0);
+    tenants.put(1, 1, 1);
+    check(!tenants.try_get(1, 1, value), "TenantLRUCache(0) stored an entry");
+    HeterogeneousLRUCache<int> heterogeneous(0);
+    heterogeneous.put(1, 1);
+    check(!heterogeneous.try_get(1, value), "HeterogeneousLRUCache(0) stored an entry");
+    SharedLRUCache shared(0, 16);
+    shared.put("a", "b");
+    check(!shared.erase("a"), "SharedLRUCache(0) stored an entry");
+}
+
+void test_arbiter() {
+    auto busy = std::make_shared<LRUCache<int, std::string>>(10);
+    auto idle = std::make_shared<LRUCache<int, std::string>>(10);
+    const size_t budget = size_t(2) << 20;
+    CacheArbiter arbiter(budget);
+    arbiter.add("busy", busy);
+    arbiter.add("idle", idle);
+    std::mt19937 rng(41);
+    std::string value(100, 'x');
+    std::string out;
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < 20000; ++i) {
+            int key = int(rng() % 30000);
+            if (!busy->try_get(key, out)) {
+                busy->put(key, value);
+            }
+            key = int(rng() % 500);
+            if (!idle->try_get(key, out)) {
+                idle->put(key, value);
+            }
+        }
+        arbiter.rebalance();
+        check(arbiter.share("busy") + arbiter.share("idle") == budget, "CacheArbiter: shares don't add up");
+    }
+    check(arbiter.share("busy") > arbiter.share("idle"), "CacheArbiter: budget didn't move to the cache missing more");
+}
+
+// Loopback client helpers for the server checks
+static int connect_to(uint16_t port) {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+            return fd;
+        }
+        ::close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));  // Server still starting
+    }
+    return -1;
+}
+
+static void send_all(int fd, const std::string& data) {
+    for (size_t sent = 0; sent < data.size();) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return;
+        }
+        sent += size_t(n);
+    }
+}
+
+static std::string read_until_close(int fd) {
+    std::string data;
+    char buffer[65536];
+    for (;;) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            return data;
+        }
+        data.append(buffer, size_t(n));
+    }
+}
+
+static std::string read_exactly(int fd, size_t bytes) {
+    std::string data;
+    char buffer[65536];
+    while (data.size() < bytes) {
+        ssize_t n = recv(fd, buffer, std::min(sizeof(buffer), bytes - data.size()), 0);
+        if (n <= 0) {
+            break;
+        }
+        data.append(buffer, size_t(n));
+    }
+    return data;
+}
+
+// Sends request and returns everything the server answers before closing
+static std::string half_close(uint16_t port, const std::string& request) {
+    int fd = connect_to(port);
+    if (fd < 0) {
+        return std::string();
+    }
+    send_all(fd, request);
+    shutdown(fd, SHUT_WR);
+    std::string reply = read_until_close(fd);
+    ::close(fd);
+    return reply;
+}
+
+static size_t count_of(const std::string& text, const std::string& needle) {
+    size_t count = 0;
+    for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + needle.size())) {
+        ++count;
+    }
+    return count;
+}
+
+void test_server(const std::string& server, bool uring) {
+    std::string name = uring ? "cacheServer --io-uring" : "cacheServer";
+    uint16_t port = uint16_t(20000 + getpid() % 20000 + (uring ? 1 : 0));
+    pid_t child = fork();
+    if (child == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);  // Keeps the server's banner out of the report
+        std::string port_arg = std::to_string(port);
+        if (uring) {
+            execl(server.c_str(), server.c_str(), "--io-uring", port_arg.c_str(), "2", "10000", (char*)nullptr);
+        } else {
+            execl(server.c_str(), server.c_str(), port_arg.c_str(), "2", "10000", (char*)nullptr);
+        }
+        _exit(127);
+    }
+
+    int fd = connect_to(port);
+    check(fd >= 0, name + ": can't connect");
+    if (fd >= 0) {
+        auto command = [fd](const std::string& request, const std::string& expected) {
+            send_all(fd, request);
+            return read_exactly(fd, expected.size()) == expected;
+        };
+        std::string big(100000, 'b');
+        check(command("set small 5 0 3\r\nabc\r\n", "STORED\r\n"), name + ": set");
+        check(command("set big 0 0 100000\r\n" + big + "\r\n", "STORED\r\n"), name + ": set big");
+        check(command("get small nothing\r\n", "VALUE small 5 3\r\nabc\r\nEND\r\n"), name + ": get");
+        check(command("get\r\n", "ERROR\r\n"), name + ": get without keys");
+        check(command("set n 0 0 1\r\n7\r\nincr n 5\r\n", "STORED\r\n12\r\n"), name + ": incr");
+        check(command("set gone 0 -1 1\r\nx\r\nget gone\r\n", "STORED\r\nEND\r\n"), name + ": negative exptime");
+        check(command("delete n\r\ndelete n\r\n", "DELETED\r\nNOT_FOUND\r\n"), name + ": delete");
+        ::close(fd);
+
+        // Pipelined requests that arrive with the FIN are all answered
+        std::string gets;
+        for (int i = 0; i < 50; ++i) {
+            gets += "get small\r\n";
+        }
+        std::vector<std::thread> clients;
+        std::vector<size_t> answered(64);
+        for (size_t c = 0; c < answered.size(); ++c) {
+            clients.emplace_back([&, c] { answered[c] = count_of(half_close(port, gets), "END\r\n"); });
+        }
+        for (auto& client : clients) {
+            client.join();
+        }
+        size_t complete = 0;
+        for (size_t count : answered) {
+            complete += count == 50;
+        }
+        check(complete == answered.size(), name + ": " + std::to_string(answered.size() - complete)
+              + " half-closed clients missed replies");
+
+        std::string big_gets;
+        for (int i = 0; i < 100; ++i) {
+            big_gets += "get big\r\n";
+        }
+        std::string reply = half_close(port, big_gets);
+        check(count_of(reply, "END\r\n") == 100 && reply.size() == 100 * (big.size() + 27),
+              name + ": " + std::to_string(count_of(reply, "END\r\n")) + "/100 large gets answered before a half-close");
+        check(half_close(port, "get small\r\nget sm").find("abc") != std::string::npos,
+              name + ": partial request after a half-close");
+    }
+
+    kill(child, SIGTERM);
+    int status = 0;
+    waitpid(child, &status, 0);
+}
+
+int main(int argc, char* argv[]) {
+    std::signal(SIGPIPE, SIG_IGN);
+    test_incremental_hash_map();
+    test_lru_caches();
+    test_other_policies();
+    test_slab_cache();
+    test_capacity_zero();
+    test_arbiter();
+    if (argc > 1) {
+        test_server(argv[1], false);
+        test_server(argv[1], true);
+    }
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << (argc > 1 ? "" : " (server not tested)") << std::endl;
+    return 0;
+}
@@ -0,0 +1,191 @@
+#ifndef HUGEPAGEARENA_H
+#define HUGEPAGEARENA_H
+
+// Memory resource over one mmap'd region backed by huge pages, for caches
+// with tens of millions of entries where TLB misses add to every lookup:
+//   HugePageArena arena(size_t(4) << 30);
+//   LRUCache<uint64_t, Session> cache(50000000, &arena);
+// The region is mapped with explicit huge pages (MAP_HUGETLB) if the system
+// has a hugetlb pool, else as normal memory aligned to 2 MB with
+// MADV_HUGEPAGE so transparent huge pages back it. With prefault set every
+// page is touched at construction, so the first requests don't pay for page
+// faults. Freed blocks are reused per size, so fixed-size cache nodes recycle
+// in O(1); once the region is full, allocations go to the upstream resource.
+
+#include <memory_resource>
+#include <map>
+#include <mutex>
+#include <system_error>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <sys/mman.h>
+#include <unistd.h>
+
+class HugePageArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t huge_page_size = size_t(2) << 20;
+
+    explicit HugePageArena(size_t bytes, bool prefault = true,
+                           std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : upstream(upstream) {
+        size = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | (prefault ? MAP_POPULATE : 0);
+        void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if (region != MAP_FAILED) {
+            explicit_huge_pages = true;
+        } else {
+            region = map_transparent(prefault);
+        }
+        base = static_cast<char*>(region);
+        next = base;
+    }
+
+    ~HugePageArena() override {
+        munmap(base, size);
+    }
+
+    HugePageArena(const HugePageArena&) = delete;
+    HugePageArena& operator=(const HugePageArena&) = delete;
+
+    // Whether the region came from the hugetlb pool rather than transparent huge pages
+    bool uses_explicit_huge_pages() const {
+        return explicit_huge_pages;
+    }
+
+    size_t capacity() const {
+        return size;
+    }
+
+    // Bytes handed out from the region and not yet returned
+    size_t used() {
+        std::lock_guard<std::mutex> lock(arena_mutex);
+        return in_use;
+    }
+
+private:
+    static constexpr size_t granule = alignof(std::max_align_t);
+    static constexpr size_t small_limit = 1024;  // Larger blocks are reused best-fit from a map
+
+    // Normal pages aligned to a huge page boundary, so THP can cover the whole region
+    void* map_transparent(bool prefault) {
+        size_t reserved = size + huge_page_size;
+        void* raw = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+        uintptr_t start = (reinterpret_cast<uintptr_t>(raw) + huge_page_size - 1) & ~(huge_page_size - 1);
+        char* region = reinterpret_cast<char*>(start);
+        size_t head = region - static_cast<char*>(raw);
+        if (head) {
+            munmap(raw, head);
+        }
+        munmap(region + size, reserved - head - size);
+#ifdef MADV_HUGEPAGE
+        madvise(region, size, MADV_HUGEPAGE);
+#endif
+        if (prefault) {
+            // MAP_POPULATE would fault 4 KB pages before the advice applies
+#ifdef MADV_POPULATE_WRITE
+            if (madvise(region, size, MADV_POPULATE_WRITE) == 0) {
+                return region;
+            }
+#endif
+            long page = sysconf(_SC_PAGESIZE);
+            for (size_t offset = 0; offset < size; offset += page) {
+                static_cast<volatile char*>(static_cast<void*>(region))[offset] = 0;
+            }
+        }
+        return region;
+    }
+
+    static size_t round_up(size_t bytes) {
+        return bytes ? (bytes + granule - 1) / granule * granule : granule;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        size_t rounded = round_up(bytes);
+        {
+            std::lock_guard<std::mutex> lock(arena_mutex);
+            if (alignment <= granule) {
+                if (void* block = take_free(rounded)) {
+                    in_use += rounded;
+                    return block;
+                }
+            }
+            uintptr_t start = (reinterpret_cast<uintptr_t>(next) + alignment - 1) & ~(alignment - 1);
+            char* block = reinterpret_cast<char*>(start);
+            if (block + rounded <= base + size) {
+                next = block + rounded;
+                in_use += rounded;
+                return block;
+            }
+        }
+        return upstream->allocate(bytes, alignment);  // Region exhausted
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        char* block = static_cast<char*>(p);
+        if (block < base || block >= base + size) {
+            upstream->deallocate(p, bytes, alignment);
+            return;
+        }
+        size_t rounded = round_up(bytes);
+        std::lock_guard<std::mutex> lock(arena_mutex);
+        in_use -= rounded;
+        push_free(block, rounded);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    // A free block of exactly this size, or for large sizes the smallest one that fits
+    void* take_free(size_t rounded) {
+        if (rounded <= small_limit) {
+            FreeBlock*& head = small_free[rounded / granule];
+            FreeBlock* block = head;
+            if (block) {
+                head = block->next;
+            }
+            return block;
+        }
+        auto it = large_free.lower_bound(rounded);
+        if (it == large_free.end()) {
+            return nullptr;
+        }
+        void* block = it->second;
+        size_t spare = it->first - rounded;
+        large_free.erase(it);
+        if (spare) {
+            push_free(static_cast<char*>(block) + rounded, spare);  // Keep the unused end of a split block
+        }
+        return block;
+    }
+
+    void push_free(char* block, size_t rounded) {
+        if (rounded <= small_limit) {
+            FreeBlock*& head = small_free[rounded / granule];
+            head = new (block) FreeBlock{head};
+        } else {
+            large_free.emplace(rounded, block);
+        }
+    }
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::pmr::memory_resource* upstream;  // Takes over once the region is full
+    char* base;
+    size_t size;  // Region length, a multiple of the huge page size
+    bool explicit_huge_pages = false;
+    std::mutex arena_mutex;  // Caches allocate outside their own locks
+    char* next;  // Bump pointer into the never-used part of the region
+    size_t in_use = 0;
+    FreeBlock* small_free[small_limit / granule + 1] = {};  // Freed blocks by size / granule
+    std::multimap<size_t, void*> large_free;  // Freed blocks above small_limit by size
+};
+
+#endif // HUGEPAGEARENA_H
@@ -0,0 +1,472 @@
+#ifndef SHAREDCACHE_H
+#define SHAREDCACHE_H
+
+// LRU cache living entirely in a shared-memory segment, so co-located
+// processes share one copy of the data. Everything inside the segment is
+// addressed by index rather than pointer, because each process maps it at a
+// different address. The lock is a robust process-shared mutex: if a process
+// dies while holding it, the next locker recovers, and if the dead process
+// was in the middle of an update the cache is cleared instead of trusted.
+// A creator that fails or dies before the segment is initialized doesn't
+// block later processes: they give up waiting after attach_timeout and
+// replace a named segment that was never initialized.
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class SharedLRUCache {
+public:
+    // How long an attaching process waits for the creator to initialize the segment
+    static constexpr std::chrono::seconds attach_timeout{5};
+
+    // Creates the named segment (shm_open) or attaches to it if it exists;
+    // an attaching process adopts the geometry chosen by the creator
+    SharedLRUCache(const std::string& name, size_t capacity, size_t max_item_size) {
+        bool replaced = false;
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd >= 0) {
+                create(capacity, max_item_size, name.c_str());
+                return;
+            }
+            if (errno != EEXIST) {
+                throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+            }
+            fd = shm_open(name.c_str(), O_RDWR, 0600);
+            if (fd < 0) {
+                if (errno == ENOENT) {
+                    continue;  // Unlinked in between; try creating it again
+                }
+                throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+            }
+            if (attach()) {
+                return;
+            }
+            if (replaced) {
+                break;
+            }
+            remove_stale(name);  // The creator failed or died before initializing it
+            replaced = true;
+        }
+        throw std::runtime_error("Shared cache segment " + name + " never became ready");
+    }
+
+    // Creates an anonymous memfd segment, shared with children created by
+    // fork or with processes that receive segment_fd() over a unix socket
+    SharedLRUCache(size_t capacity, size_t max_item_size) {
+        fd = memfd_create("SharedLRUCache", MFD_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "memfd_create");
+        }
+        create(capacity, max_item_size, nullptr);
+    }
+
+    // Attaches to a segment received as a file descriptor; takes ownership of it
+    explicit SharedLRUCache(int segment_fd) : fd(segment_fd) {
+        if (!attach()) {
+            throw std::runtime_error("Shared cache segment never became ready");
+        }
+    }
+
+    ~SharedLRUCache() {
+        munmap(base, mapped_size);
+        ::close(fd);
+    }
+
+    SharedLRUCache(const SharedLRUCache&) = delete;
+    SharedLRUCache& operator=(const SharedLRUCache&) = delete;
+
+    // Removes a named segment; processes still attached keep their mapping
+    static void unlink(const std::string& name) {
+        shm_unlink(name.c_str());
+    }
+
+    int segment_fd() const {
+        return fd;
+    }
+
+    // Function to retrieve a value from the cache
+    std::string get(std::string_view key) {
+        std::string value;
+        if (!try_get(key, value)) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+        return value;
+    }
+
+    // Function to retrieve a value w/o throwing, returns false on a miss
+    bool try_get(std::string_view key, std::string& value) {
+        return read(key, [&value](std::string_view data) { value.assign(data.data(), data.size()); });
+    }
+
+    // Zero-copy read: calls visit(std::string_view) on the value in shared
+    // memory while the lock is held. The view must not escape the visitor.
+    template<typename Visitor>
+    bool read(std::string_view key, Visitor&& visit) {
+        Lock lock(*this);
+        uint64_t hash = hash_key(key);
+        uint32_t index = find(key, hash);
+        if (index == nil) {
+            return false;
+        }
+
+        begin_update();
+        unlink_lru(index);
+        push_front(index);  // Moves accessed node
+        end_update();
+        Node& node = nodes[index];
+        visit(std::string_view(slot(index) + node.key_size, node.value_size));
+        return true;
+    }
+
+    // Function to insert or update a value in the cache
+    void put(std::string_view key, std::string_view value) {
+        if (key.size() + value.size() > header->slot_size) {
+            throw std::length_error("Item larger than the segment's max_item_size");
+        }
+        Lock lock(*this);
+        if (header->capacity == 0) {
+            return;
+        }
+        begin_update();
+        uint64_t hash = hash_key(key);
+        uint32_t index = find(key, hash);
+        if (index != nil) {
+            unlink_lru(index);  // If key exists -> MRU
+        } else {
+            if (header->size >= header->capacity) {
+                remove(header->lru_tail);  // If cache full, evict the LRU item
+            }
+            index = header->free_head;
+            header->free_head = nodes[index].next;
+            Node& node = nodes[index];
+            node.hash = hash;
+            node.key_size = uint32_t(key.size());
+            std::memcpy(slot(index), key.data(), key.size());
+            uint32_t& bucket = buckets[hash & (header->bucket_count - 1)];
+            node.hash_next = bucket;
+            bucket = index;
+            ++header->size;
+        }
+        nodes[index].value_size = uint32_t(value.size());
+        std::memcpy(slot(index) + key.size(), value.data(), value.size());
+        push_front(index);
+        end_update();
+    }
+
+    // Function to remove an object from the cache if it exists, returns whether it did
+    bool erase(std::string_view key) {
+        Lock lock(*this);
+        uint32_t index = find(key, hash_key(key));
+        if (index == nil) {
+            return false;
+        }
+        begin_update();
+        remove(index);
+        end_update();
+        return true;
+    }
+
+    // Function to dynamically adjust the cache's capacity, up to the segment's node count
+    void resize(size_t new_capacity) {
+        if (new_capacity > header->node_count) {
+            throw std::length_error("Capacity exceeds the nodes allocated in the segment");
+        }
+        Lock lock(*this);
+        begin_update();
+        while (header->size > new_capacity) {
+            remove(header->lru_tail);
+        }
+        header->capacity = new_capacity;
+        end_update();
+    }
+
+private:
+    static constexpr uint64_t magic_value = 0x5453434143484531ull;  // "TSCACHE1"
+    static constexpr uint32_t nil = UINT32_MAX;
+
+    // Segment layout: Header | buckets[bucket_count] | nodes[node_count] | slots[node_count]
+    struct Header {
+        std::atomic<uint64_t> magic;  // Set last, once the creator has initialized everything
+        pthread_mutex_t mutex;
+        uint64_t total_size;
+        uint64_t capacity;
+        uint64_t node_count;
+        uint64_t bucket_count;
+        uint64_t slot_size;
+        uint64_t size;
+        uint32_t lru_head;
+        uint32_t lru_tail;
+        uint32_t free_head;
+        std::atomic<uint32_t> dirty;  // Non-zero while the lock holder is mid-update
+    };
+
+    // Header atomics are shared between processes, so they must not fall back to a lock
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "SharedLRUCache needs lock-free atomics in shared memory");
+
+    struct Node {
+        uint64_t hash;
+        uint32_t prev;  // LRU neighbours, towards the head (MRU) and tail (LRU)
+        uint32_t next;  // Also links the free list
+        uint32_t hash_next;
+        uint32_t key_size;
+        uint32_t value_size;
+    };
+
+    // Locks the segment, recovering it if the previous owner died
+    class Lock {
+    public:
+        explicit Lock(SharedLRUCache& cache) : cache(cache) {
+            int rc = pthread_mutex_lock(&cache.header->mutex);
+            if (rc == EOWNERDEAD) {
+                if (cache.header->dirty.load(std::memory_order_acquire)) {
+                    cache.reset();  // Half-applied update: drop the contents
+                }
+                pthread_mutex_consistent(&cache.header->mutex);
+            } else if (rc != 0) {
+                throw std::system_error(rc, std::generic_category(), "pthread_mutex_lock");
+            }
+        }
+
+        ~Lock() {
+            pthread_mutex_unlock(&cache.header->mutex);
+        }
+
+    private:
+        SharedLRUCache& cache;
+    };
+
+    static size_t align(size_t n) {
+        return (n + 63) & ~size_t(63);
+    }
+
+    // FNV-1a, so every process (and binary) agrees on bucket placement
+    static uint64_t hash_key(std::string_view key) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Sizes and initializes a new segment. On failure the fd is closed and a
+    // named segment unlinked, so no half-made segment is left behind.
+    void create(size_t capacity, size_t max_item_size, const char* name) {
+        try {
+            initialize(capacity, max_item_size);
+        } catch (...) {
+            if (base != nullptr) {
+                munmap(base, mapped_size);
+            }
+            ::close(fd);
+            if (name != nullptr) {
+                shm_unlink(name);
+            }
+            throw;
+        }
+    }
+
+    void initialize(size_t capacity, size_t max_item_size) {
+        if (capacity >= nil || max_item_size >= nil) {
+            throw std::length_error("Shared cache geometry exceeds 32-bit indices");
+        }
+        size_t bucket_count = 1;
+        while (bucket_count < capacity + capacity / 3 + 1) {
+            bucket_count <<= 1;
+        }
+        size_t slot_size = align(max_item_size);
+        size_t total = align(sizeof(Header)) + align(bucket_count * sizeof(uint32_t))
+                     + align(capacity * sizeof(Node)) + capacity * slot_size;
+        if (ftruncate(fd, off_t(total)) < 0) {
+            throw std::system_error(errno, std::generic_category(), "ftruncate");
+        }
+        map(total);
+
+        header->total_size = total;
+        header->capacity = capacity;
+        header->node_count = capacity;
+        header->bucket_count = bucket_count;
+        header->slot_size = slot_size;
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        locate();
+        reset();
+        header->magic.store(magic_value, std::memory_order_release);
+    }
+
+    // Waits for the creator to finish initializing, then maps the whole segment.
+    // Returns false, with the segment unmapped but fd still open, if that takes
+    // longer than attach_timeout; on errors the fd is closed before throwing.
+    bool attach() {
+        auto deadline = std::chrono::steady_clock::now() + attach_timeout;
+        try {
+            struct stat st;
+            for (;;) {
+                if (fstat(fd, &st) < 0) {
+                    throw std::system_error(errno, std::generic_category(), "fstat");
+                }
+                if (size_t(st.st_size) >= sizeof(Header)) {
+                    break;
+                }
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            map(size_t(st.st_size));
+            while (header->magic.load(std::memory_order_acquire) != magic_value) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    munmap(base, mapped_size);
+                    base = nullptr;
+                    header = nullptr;
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (header->total_size != mapped_size) {
+                throw std::runtime_error("Shared cache segment has an unexpected size");
+            }
+        } catch (...) {
+            if (base != nullptr) {
+                munmap(base, mapped_size);
+            }
+            ::close(fd);
+            throw;
+        }
+        locate();
+        return true;
+    }
+
+    // Unlinks the name if it still refers to the uninitialized segment open as fd, then closes fd
+    void remove_stale(const std::string& name) {
+        struct stat ours;
+        struct stat current;
+        int current_fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (current_fd >= 0) {
+            if (fstat(fd, &ours) == 0 && fstat(current_fd, &current) == 0 && ours.st_ino == current.st_ino) {
+                shm_unlink(name.c_str());
+            }
+            ::close(current_fd);
+        }
+        ::close(fd);
+        fd = -1;
+    }
+
+    void map(size_t size) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+        base = static_cast<char*>(ptr);
+        mapped_size = size;
+        header = reinterpret_cast<Header*>(base);
+    }
+
+    // Resolves this process's pointers to the arrays from the header's geometry
+    void locate() {
+        char* p = base + align(sizeof(Header));
+        buckets = reinterpret_cast<uint32_t*>(p);
+        p += align(header->bucket_count * sizeof(uint32_t));
+        nodes = reinterpret_cast<Node*>(p);
+        p += align(header->node_count * sizeof(Node));
+        slots = p;
+    }
+
+    // Empties the cache: all nodes on the free list, no buckets in use
+    void reset() {
+        for (uint64_t i = 0; i < header->bucket_count; ++i) {
+            buckets[i] = nil;
+        }
+        for (uint64_t i = 0; i < header->node_count; ++i) {
+            nodes[i].next = i + 1 < header->node_count ? uint32_t(i + 1) : nil;
+        }
+        header->free_head = header->node_count ? 0 : nil;
+        header->lru_head = header->lru_tail = nil;
+        header->size = 0;
+        header->dirty.store(0, std::memory_order_release);
+    }
+
+    // Flags the segment as mid-update before the lock holder changes it. The
+    // fence keeps the update's stores from being issued ahead of the flag, so
+    // a holder that dies part-way always leaves it set for the next locker.
+    void begin_update() {
+        header->dirty.store(1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // Clears the flag; the release store orders it after the update's stores
+    void end_update() {
+        header->dirty.store(0, std::memory_order_release);
+    }
+
+    char* slot(uint32_t index) {
+        return slots + index * header->slot_size;
+    }
+
+    uint32_t find(std::string_view key, uint64_t hash) {
+        for (uint32_t i = buckets[hash & (header->bucket_count - 1)]; i != nil; i = nodes[i].hash_next) {
+            if (nodes[i].hash == hash && nodes[i].key_size == key.size()
+                    && std::memcmp(slot(i), key.data(), key.size()) == 0) {
+                return i;
+            }
+        }
+        return nil;
+    }
+
+    void unlink_lru(uint32_t index) {
+        Node& node = nodes[index];
+        (node.prev == nil ? header->lru_head : nodes[node.prev].next) = node.next;
+        (node.next == nil ? header->lru_tail : nodes[node.next].prev) = node.prev;
+    }
+
+    void push_front(uint32_t index) {
+        Node& node = nodes[index];
+        node.prev = nil;
+        node.next = header->lru_head;
+        (header->lru_head == nil ? header->lru_tail : nodes[header->lru_head].prev) = index;
+        header->lru_head = index;
+    }
+
+    // Unlinks a node from its bucket and the LRU list and frees it
+    void remove(uint32_t index) {
+        Node& node = nodes[index];
+        uint32_t* link = &buckets[node.hash & (header->bucket_count - 1)];
+        while (*link != index) {
+            link = &nodes[*link].hash_next;
+        }
+        *link = node.hash_next;
+        unlink_lru(index);
+        node.next = header->free_head;
+        header->free_head = index;
+        --header->size;
+    }
+
+    int fd = -1;
+    char* base = nullptr;
+    size_t mapped_size = 0;
+    // This process's view of the segment
+    Header* header = nullptr;
+    uint32_t* buckets = nullptr;
+    Node* nodes = nullptr;
+    char* slots = nullptr;
+};
+
+#endif // SHAREDCACHE_H
@@ -0,0 +1,538 @@
+#ifndef SLABCACHE_H
+#define SLABCACHE_H
+
+// memcached-style string cache whose items live in slab pages carved out of
+// one region mapped at construction. Each page belongs to a size class and is
+// cut into equal chunks; an item (header, key and value together) takes the
+// smallest chunk it fits, and each class keeps its own LRU list. put never
+// calls malloc: it reuses a freed chunk of its class, carves a new one, takes
+// an unassigned page or else evicts its class's LRU item. Since a chunk is only
+// ever reused by items of the same class, memory doesn't fragment however long
+// the process runs, and at most one growth factor is lost to rounding. As in
+// memcached, once every page is assigned a class can only recycle its own
+// chunks, so an item whose class owns no pages is not stored, until
+// compact() moves pages around.
+//
+// compact() empties the sparsest pages of each class by relocating their
+// items into the class's free chunks (relinking the LRU neighbours and hash
+// chain under the lock, one page per lock hold) and returns the pages to the
+// OS with madvise(MADV_DONTNEED), so RSS follows the live data after churn.
+// Freed pages go to a shared pool any class can claim, and if the pool is
+// empty the class with the most evictions and rejected puts since the last
+// pass is granted the sparsest page of the class with the fewest; items that
+// page still held count as the donor's evictions. With a compact_interval a
+// background thread runs compact() periodically.
+//   SlabLRUCache cache(size_t(1) << 30);
+//   cache.put("user:42", serialized);
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <new>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+#include <sys/mman.h>
+
+// Per size class figures reported by SlabLRUCache::stats()
+struct SlabClassStats {
+    size_t chunk_size;  // Bytes per chunk, item header included
+    size_t pages;
+    size_t items;
+    size_t free_chunks;  // Freed chunks waiting to be reused
+    uint64_t evictions;
+    uint64_t rejected;  // Items not stored because the class had no memory
+};
+
+class SlabLRUCache {
+public:
+    static constexpr size_t min_chunk_size = 64;
+
+    // Maps memory_bytes (rounded down to whole pages) up front; chunk sizes
+    // grow by growth_factor from min_chunk_size up to one item per page.
+    // With a non-zero compact_interval a background thread calls compact() periodically.
+    explicit SlabLRUCache(size_t memory_bytes, size_t page_size = size_t(1) << 20, double growth_factor = 1.25,
+                          std::chrono::milliseconds compact_interval = std::chrono::milliseconds(0))
+        : page_size(page_size), compact_interval(compact_interval) {
+        if (growth_factor <= 1.0 || page_size < min_chunk_size) {
+            throw std::invalid_argument("Slab growth factor must exceed 1 and pages must hold a chunk");
+        }
+        for (size_t chunk = min_chunk_size; chunk < page_size / 2;) {
+            classes.push_back(SlabClass{chunk});
+            chunk = std::max(chunk + alignof(Item), align(size_t(chunk * growth_factor)));
+        }
+        classes.push_back(SlabClass{page_size});  // Largest items take a page each
+
+        page_count = std::max<size_t>(1, memory_bytes / page_size);
+        void* region = mmap(nullptr, page_count * page_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+        base = static_cast<char*>(region);
+
+        bucket_count = 1024;
+        while (bucket_count < page_count * page_size / (2 * min_chunk_size)) {
+            bucket_count <<= 1;  // Chains stay short even if every item is in the smallest class
+        }
+        buckets = static_cast<Item**>(std::calloc(bucket_count, sizeof(Item*)));  // Untouched pages stay unbacked
+        if (buckets == nullptr) {
+            munmap(base, page_count * page_size);
+            throw std::bad_alloc();
+        }
+        page_class.assign(page_count, no_class);
+        page_live.assign(page_count, 0);
+        free_pages.reserve(page_count);
+
+        if (compact_interval.count() > 0) {
+            worker = std::thread([this] { run(); });
+        }
+    }
+
+    ~SlabLRUCache() {
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+        std::free(buckets);
+        munmap(base, page_count * page_size);
+    }
+
+    SlabLRUCache(const SlabLRUCache&) = delete;
+    SlabLRUCache& operator=(const SlabLRUCache&) = delete;
+
+    // Function to retrieve a value from the cache
+    std::string get(std::string_view key) {
+        std::string value;
+        if (!try_get(key, value)) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+        return value;
+    }
+
+    // Function to retrieve a value w/o throwing, returns false on a miss; reuses value's storage
+    bool try_get(std::string_view key, std::string& value) {
+        return read(key, [&value](std::string_view data) { value.assign(data.data(), data.size()); });
+    }
+
+    // Zero-copy read: calls visit(std::string_view) on the value in its slab
+    // while the lock is held. The view must not escape the visitor.
+    template<typename Visitor>
+    bool read(std::string_view key, Visitor&& visit) {
+        uint64_t hash = hash_key(key);
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        Item* item = find(key, hash);
+        if (item == nullptr) {
+            return false;
+        }
+        SlabClass& owner = classes[item->slab_class];
+        unlink_lru(owner, item);
+        push_front(owner, item);  // Moves accessed item
+        visit(item->value());
+        return true;
+    }
+
+    // Function to insert or update a value in the cache
+    void put(std::string_view key, std::string_view value) {
+        size_t needed = sizeof(Item) + key.size() + value.size();
+        if (needed > page_size || key.size() >= UINT32_MAX || value.size() >= UINT32_MAX) {
+            throw std::length_error("Item larger than a slab page");
+        }
+        size_t class_id = class_for(needed);
+        uint64_t hash = hash_key(key);
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        if (Item* old = find(key, hash)) {
+            remove(old);  // The new value may belong to another class
+        }
+        Item* item = allocate(class_id);
+        if (item == nullptr) {
+            ++classes[class_id].rejected;  // Class owns no memory and no page is left
+            return;
+        }
+        item->hash = hash;
+        item->key_size = uint32_t(key.size());
+        item->value_size = uint32_t(value.size());
+        item->slab_class = uint32_t(class_id);
+        item->live = 1;
+        ++page_live[page_of(item)];
+        std::memcpy(item->data(), key.data(), key.size());
+        std::memcpy(item->data() + key.size(), value.data(), value.size());
+        Item*& bucket = buckets[hash & (bucket_count - 1)];
+        item->hash_next = bucket;
+        bucket = item;
+        push_front(classes[class_id], item);
+        ++classes[class_id].items;
+        ++item_count;
+    }
+
+    // Function to remove an object from the cache if it exists, returns whether it did
+    bool erase(std::string_view key) {
+        uint64_t hash = hash_key(key);
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        Item* item = find(key, hash);
+        if (item == nullptr) {
+            return false;
+        }
+        remove(item);
+        return true;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return item_count;
+    }
+
+    // Bytes of the slab region
+    size_t capacity() const {
+        return page_count * page_size;
+    }
+
+    // Function to report chunk size, pages, items, evictions and rejections for each size class
+    std::vector<SlabClassStats> stats() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        std::vector<SlabClassStats> result;
+        for (const SlabClass& c : classes) {
+            result.push_back(SlabClassStats{c.chunk_size, c.pages, c.items, c.free_chunks, c.evictions, c.rejected});
+        }
+        return result;
+    }
+
+    // Pages returned to the OS and not yet claimed by a class
+    size_t free_page_count() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return free_pages.size();
+    }
+
+    // Function to run one compaction and rebalancing pass, returns the number of pages released
+    size_t compact() {
+        size_t released = 0;
+        for (size_t class_id = 0; class_id < classes.size(); ++class_id) {
+            for (;;) {
+                std::lock_guard<std::mutex> lock(cache_mutex); // Held for one page at a time
+                size_t page = sparse_page(class_id);
+                if (page == no_page) {
+                    break;
+                }
+                release_page(page);
+                free_pages.push_back(page);
+                ++released;
+            }
+        }
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (rebalance()) {
+            ++released;
+        }
+        return released;
+    }
+
+private:
+    // Chunk header; key then value bytes follow it
+    struct Item {
+        Item* prev;  // LRU neighbours within the class, towards the head (MRU) and tail (LRU)
+        Item* next;  // Also links the class's free chunks
+        Item* hash_next;
+        uint64_t hash;
+        uint32_t key_size;
+        uint32_t value_size;
+        uint32_t slab_class;
+        uint32_t live;  // 0 for free chunks; released pages read back as zeros
+
+        char* data() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+
+        std::string_view key() {
+            return std::string_view(data(), key_size);
+        }
+
+        std::string_view value() {
+            return std::string_view(data() + key_size, value_size);
+        }
+    };
+
+    struct SlabClass {
+        size_t chunk_size;
+        Item* lru_head = nullptr;
+        Item* lru_tail = nullptr;
+        Item* free_list = nullptr;  // Chunks of removed items
+        char* carve_next = nullptr;  // Never-used chunks of the class's newest page
+        char* carve_end = nullptr;
+        size_t pages = 0;
+        size_t items = 0;
+        size_t free_chunks = 0;
+        uint64_t evictions = 0;
+        uint64_t rejected = 0;
+        uint64_t last_pressure = 0;  // evictions + rejected as of the previous rebalance
+        size_t granted_page = SIZE_MAX;  // Page rebalance() moved here, carved before any other
+
+        uint64_t recent_pressure() const {
+            return evictions + rejected - last_pressure;
+        }
+    };
+
+    static constexpr uint32_t no_class = UINT32_MAX;
+    static constexpr size_t no_page = SIZE_MAX;
+
+    static size_t align(size_t n) {
+        return (n + alignof(Item) - 1) & ~(alignof(Item) - 1);
+    }
+
+    static uint64_t hash_key(std::string_view key) {
+        return std::hash<std::string_view>()(key);
+    }
+
+    // Smallest class whose chunks hold needed bytes
+    size_t class_for(size_t needed) const {
+        size_t low = 0;
+        size_t high = classes.size() - 1;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (classes[mid].chunk_size < needed) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    Item* find(std::string_view key, uint64_t hash) {
+        for (Item* item = buckets[hash & (bucket_count - 1)]; item != nullptr; item = item->hash_next) {
+            if (item->hash == hash && item->key() == key) {
+                return item;
+            }
+        }
+        return nullptr;
+    }
+
+    // A chunk of the class: freed, then never used, then a fresh page, then the class's LRU victim
+    Item* allocate(size_t class_id) {
+        SlabClass& c = classes[class_id];
+        if (c.free_list != nullptr) {
+            Item* item = c.free_list;
+            c.free_list = item->next;
+            --c.free_chunks;
+            return item;
+        }
+        if (c.carve_next == c.carve_end
+                && (c.granted_page != no_page || !free_pages.empty() || next_page < page_count)) {
+            size_t page = next_page;
+            if (c.granted_page != no_page) {
+                page = c.granted_page;
+                c.granted_page = no_page;
+            } else if (!free_pages.empty()) {
+                page = free_pages.back();  // Released by compact()
+                free_pages.pop_back();
+            } else {
+                ++next_page;
+            }
+            page_class[page] = uint32_t(class_id);
+            c.carve_next = base + page * page_size;
+            c.carve_end = c.carve_next + page_size / c.chunk_size * c.chunk_size;
+            ++c.pages;
+        }
+        if (c.carve_next != c.carve_end) {
+            Item* item = reinterpret_cast<Item*>(c.carve_next);
+            c.carve_next += c.chunk_size;
+            return item;
+        }
+        if (c.lru_tail == nullptr) {
+            return nullptr;
+        }
+        Item* victim = c.lru_tail;
+        unlink(victim);
+        ++c.evictions;
+        return victim;
+    }
+
+    void unlink_lru(SlabClass& c, Item* item) {
+        (item->prev == nullptr ? c.lru_head : item->prev->next) = item->next;
+        (item->next == nullptr ? c.lru_tail : item->next->prev) = item->prev;
+    }
+
+    void push_front(SlabClass& c, Item* item) {
+        item->prev = nullptr;
+        item->next = c.lru_head;
+        (c.lru_head == nullptr ? c.lru_tail : c.lru_head->prev) = item;
+        c.lru_head = item;
+    }
+
+    // Takes an item out of its bucket and its class's LRU list
+    void unlink(Item* item) {
+        Item** link = &buckets[item->hash & (bucket_count - 1)];
+        while (*link != item) {
+            link = &(*link)->hash_next;
+        }
+        *link = item->hash_next;
+        SlabClass& c = classes[item->slab_class];
+        unlink_lru(c, item);
+        item->live = 0;
+        --page_live[page_of(item)];
+        --c.items;
+        --item_count;
+    }
+
+    // Unlinks an item and returns its chunk to the class's free list
+    void remove(Item* item) {
+        unlink(item);
+        SlabClass& c = classes[item->slab_class];
+        item->next = c.free_list;
+        c.free_list = item;
+        ++c.free_chunks;
+    }
+
+    size_t page_of(const void* chunk) const {
+        return size_t(static_cast<const char*>(chunk) - base) / page_size;
+    }
+
+    // The class's page with the fewest live items, if its other pages' free
+    // chunks can take them all. The page still being carved is never chosen.
+    size_t sparse_page(size_t class_id) const {
+        const SlabClass& c = classes[class_id];
+        if (c.free_chunks < page_size / c.chunk_size) {
+            return no_page;
+        }
+        return sparsest_page(class_id);
+    }
+
+    size_t sparsest_page(size_t class_id) const {
+        const SlabClass& c = classes[class_id];
+        size_t carving = c.carve_next != c.carve_end ? page_of(c.carve_next) : no_page;
+        size_t best = no_page;
+        for (size_t page = 0; page < next_page; ++page) {
+            if (page_class[page] == class_id && page != carving
+                    && (best == no_page || page_live[page] < page_live[best])) {
+                best = page;
+            }
+        }
+        return best;
+    }
+
+    // Moves a live item to another chunk of its class, relinking its neighbours
+    void relocate(Item* item, Item* target) {
+        SlabClass& c = classes[item->slab_class];
+        std::memcpy(target, item, sizeof(Item) + item->key_size + item->value_size);
+        (target->prev == nullptr ? c.lru_head : target->prev->next) = target;
+        (target->next == nullptr ? c.lru_tail : target->next->prev) = target;
+        Item** link = &buckets[item->hash & (bucket_count - 1)];
+        while (*link != item) {
+            link = &(*link)->hash_next;
+        }
+        *link = target;
+        item->live = 0;
+        --page_live[page_of(item)];
+        ++page_live[page_of(target)];
+    }
+
+    // Empties a page into its class's other free chunks, dropping the items
+    // that don't fit, and hands it back to the OS. Returns the items dropped.
+    size_t release_page(size_t page) {
+        SlabClass& c = classes[page_class[page]];
+        char* start = base + page * page_size;
+        char* end = start + page_size / c.chunk_size * c.chunk_size;
+        for (Item** link = &c.free_list; *link != nullptr;) {
+            if (page_of(*link) == page) {
+                *link = (*link)->next;  // The page's own free chunks can't take its items
+                --c.free_chunks;
+            } else {
+                link = &(*link)->next;
+            }
+        }
+        size_t dropped = 0;
+        for (char* chunk = start; chunk != end; chunk += c.chunk_size) {
+            Item* item = reinterpret_cast<Item*>(chunk);
+            if (!item->live) {
+                continue;
+            }
+            if (c.free_list != nullptr) {
+                Item* target = c.free_list;
+                c.free_list = target->next;
+                --c.free_chunks;
+                relocate(item, target);
+            } else {
+                unlink(item);  // Only when taking a page from a class for another
+                ++dropped;
+            }
+        }
+        madvise(start, page_size, MADV_DONTNEED);
+        page_class[page] = no_class;
+        --c.pages;
+        return dropped;
+    }
+
+    // With no free page left, moves the sparsest page of the class that evicted
+    // or rejected least since the last call to the one that did so most. The
+    // page goes straight to the receiver, so no other class can claim it
+    // first, and the items dropped from it are the donor's evictions, counted
+    // towards its pressure in the next call.
+    bool rebalance() {
+        size_t receiver = no_page;
+        size_t donor = no_page;
+        for (size_t class_id = 0; class_id < classes.size(); ++class_id) {
+            const SlabClass& c = classes[class_id];
+            if (c.recent_pressure() > 0
+                    && (receiver == no_page || c.recent_pressure() > classes[receiver].recent_pressure())) {
+                receiver = class_id;
+            }
+            if (c.pages > 1 && (donor == no_page || c.recent_pressure() < classes[donor].recent_pressure())) {
+                donor = class_id;
+            }
+        }
+        size_t page = no_page;
+        if (receiver != no_page && donor != no_page && free_pages.empty() && next_page == page_count
+                && classes[receiver].granted_page == no_page
+                && classes[donor].recent_pressure() < classes[receiver].recent_pressure()) {
+            page = sparsest_page(donor);
+        }
+        for (SlabClass& c : classes) {
+            c.last_pressure = c.evictions + c.rejected;
+        }
+        if (page == no_page) {
+            return false;
+        }
+        classes[donor].evictions += release_page(page);
+        classes[receiver].granted_page = page;  // Carved on the receiver's next allocation
+        return true;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(cache_mutex);
+        while (!wakeup.wait_for(lock, compact_interval, [this] { return stopping; })) {
+            lock.unlock();
+            compact();
+            lock.lock();
+        }
+    }
+
+    size_t page_size;
+    size_t page_count;
+    char* base = nullptr;  // Slab region, page_count pages
+    size_t next_page = 0;  // Pages below this have been handed out at least once
+    std::vector<uint32_t> page_class;  // Owning class of each page, or no_class
+    std::vector<uint32_t> page_live;  // Live items on each page
+    std::vector<size_t> free_pages;  // Released pages, reused before untouched ones
+    std::vector<SlabClass> classes;  // By increasing chunk size
+    Item** buckets = nullptr;  // Hash chains of items
+    size_t bucket_count;  // A power of two
+    size_t item_count = 0;  // Items across all classes
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+    std::chrono::milliseconds compact_interval;
+    std::condition_variable wakeup;
+    bool stopping = false;
+    std::thread worker;  // Last, so it starts after the members above exist
+};
+
+#endif // SLABCACHE_H
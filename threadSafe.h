@@ -0,0 +1,2953 @@
+#ifndef THREADSAFE_H
+#define THREADSAFE_H
+
+#include <unordered_map>
+#include <array>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <memory_resource>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <optional>
+#include <any>
+#include <utility>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <functional>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "threadSafeTrace.h"
+
+// Bytes a heap allocation of n bytes really occupies: glibc malloc adds an
+// 8-byte header and rounds chunks to 16 bytes (32 minimum). Elsewhere the
+// request size is returned as is.
+inline size_t allocation_footprint(size_t n) {
+#if defined(__GLIBC__) && SIZE_MAX > 0xffffffffu
+    return std::max<size_t>(32, (n + sizeof(size_t) + 15) & ~size_t(15));
+#else
+    return n;
+#endif
+}
+
+// Heap bytes a cached key or value owns outside its own object, used by the
+// caches' memory_usage(). Overload it in your type's namespace for types that
+// own memory; anything else counts as 0.
+template<typename T>
+size_t heap_usage(const T&) {
+    return 0;
+}
+
+template<typename CharType, typename Traits, typename Alloc>
+size_t heap_usage(const std::basic_string<CharType, Traits, Alloc>& s) {
+    const char* object = reinterpret_cast<const char*>(&s);
+    const char* data = reinterpret_cast<const char*>(s.data());
+    bool inline_buffer = data >= object && data < object + sizeof(s);  // Short string optimization
+    return inline_buffer ? 0 : allocation_footprint((s.capacity() + 1) * sizeof(CharType));
+}
+
+// A shared value is counted in full by every entry holding it
+template<typename T>
+size_t heap_usage(const std::shared_ptr<T>& p) {
+    return p ? allocation_footprint(sizeof(T) + 2 * sizeof(long)) + heap_usage(*p) : 0;
+}
+
+template<typename T, typename Alloc>
+size_t heap_usage(const std::vector<T, Alloc>& v) {
+    size_t bytes = v.capacity() ? allocation_footprint(v.capacity() * sizeof(T)) : 0;
+    for (const T& element : v) {
+        bytes += heap_usage(element);
+    }
+    return bytes;
+}
+
+// Memory held by a cache, as reported by memory_usage()
+struct MemoryUsage {
+    size_t structure;  // The cache object, list nodes, index nodes and bucket arrays
+    size_t payload;  // Heap memory owned by the keys and values themselves
+
+    size_t total() const {
+        return structure + payload;
+    }
+};
+
+// Running totals reported by LRUCache::counters()
+struct CacheCounters {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;  // Entries pushed out by put or resize
+    uint64_t ghost_hits;  // Misses on keys recently evicted, see track_evicted()
+    size_t size;
+    size_t capacity;
+};
+
+// Hash index that grows without a stop-the-world rehash. Once the load factor
+// passes 1 a table twice the size is allocated (calloc'd, so large tables come
+// from fresh zero pages instead of an O(n) clear) and the old table's buckets
+// are migrated a few at a time by later inserts and erases. Lookups check the
+// old bucket while it is not yet migrated, then the new table. Nodes cache
+// their hash, so migration never rehashes keys. Each bucket also has a tag
+// byte holding a 7-bit fingerprint of its first node plus a "more nodes" bit:
+// most misses are decided from the tag alone without touching a node, and
+// keys (long strings, say) are only compared once fingerprint and full hash
+// both match. Nodes and buckets come from malloc, or from a memory_resource
+// if one is given (keys taking an allocator, like std::pmr::string, then copy
+// into it too). Only the subset of the std::unordered_map interface that the
+// caches use is provided.
+template<typename KeyType, typename MappedType, typename Hash = std::hash<KeyType>>
+class IncrementalHashMap {
+public:
+    struct Node {
+        KeyType first;
+        MappedType second;
+        Node* next;
+        uint64_t hash;
+    };
+    typedef Node* iterator;
+
+    explicit IncrementalHashMap(std::pmr::memory_resource* resource = nullptr)
+        : resource(resource), table(initial_bits, resource), old_table(0, resource) {}
+
+    ~IncrementalHashMap() {
+        free_chains(old_table, migrated);
+        free_chains(table, 0);
+    }
+
+    IncrementalHashMap(const IncrementalHashMap&) = delete;
+    IncrementalHashMap& operator=(const IncrementalHashMap&) = delete;
+
+    iterator end() const {
+        return nullptr;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Bytes of nodes and bucket arrays (the keys' own heap memory not included)
+    size_t memory_usage() const {
+        size_t bytes = count * footprint(sizeof(Node));
+        for (const Table* t : {&table, &old_table}) {
+            if (t->buckets) {
+                bytes += footprint(t->size() * (sizeof(Node*) + 1));
+            }
+        }
+        return bytes;
+    }
+
+    std::pmr::memory_resource* memory_resource() const {
+        return resource;
+    }
+
+    iterator find(const KeyType& key) const {
+        return find(key, hash_key(key));
+    }
+
+    // Lookup with a hash from hash_key(), for callers that reuse one across operations
+    iterator find(const KeyType& key, uint64_t hash) const {
+        if (old_table.buckets && old_table.index(hash) >= migrated) {
+            if (Node* node = find_in(old_table, old_table.index(hash), key, hash)) {
+                return node;
+            }
+        }
+        return find_in(table, table.index(hash), key, hash);
+    }
+
+    // Fibonacci hashing spreads weak hashes (std::hash<int> is the identity) into the top bits
+    static uint64_t hash_key(const KeyType& key) {
+        return uint64_t(Hash()(key)) * 0x9e3779b97f4a7c15ull;
+    }
+
+    // Returns the mapped value for key, inserting a default one if missing
+    MappedType& operator[](const KeyType& key) {
+        return find_or_insert(key, hash_key(key));
+    }
+
+    // Same as operator[] with a hash from hash_key()
+    MappedType& find_or_insert(const KeyType& key, uint64_t hash) {
+        Node* node = find(key, hash);
+        if (node) {
+            return node->second;
+        }
+        node = allocate_node(key, hash);
+        insert_node(node);
+        return node->second;
+    }
+
+    // Links a node from make_node() or detach() whose key and hash the caller
+    // has set; the key must not be present. Lets callers reuse nodes, and the
+    // key storage in them, instead of allocating one per insert.
+    void insert_node(Node* node) {
+        link_front(table, table.index(node->hash), node);
+        ++count;
+        migrate_some();
+        if (count > table.size()) {
+            grow();
+        }
+    }
+
+    void erase(iterator node) {
+        free_node(detach(node));
+    }
+
+    // Unlinks a node without freeing it; the caller reinserts it with
+    // insert_node() or frees it with release_node(), with no lock needed
+    Node* detach(iterator node) {
+        Node** link = nullptr;
+        if (old_table.buckets && old_table.index(node->hash) >= migrated) {
+            link = find_link(old_table.buckets[old_table.index(node->hash)], node);
+        }
+        Table* owner = &old_table;
+        if (link == nullptr) {
+            owner = &table;
+            link = find_link(table.buckets[table.index(node->hash)], node);
+        }
+        *link = node->next;
+        owner->retag(owner->index(node->hash));
+        --count;
+        migrate_some();
+        return node;
+    }
+
+    Node* make_node(const KeyType& key, uint64_t hash) {
+        return allocate_node(key, hash);
+    }
+
+    void release_node(Node* node) {
+        free_node(node);
+    }
+
+    size_t erase(const KeyType& key) {
+        Node* node = find(key);
+        if (node == nullptr) {
+            return 0;
+        }
+        erase(node);
+        return 1;
+    }
+
+private:
+    static constexpr unsigned initial_bits = 4;
+    static constexpr size_t migrate_step = 4;  // Old buckets moved per insert/erase
+
+    static constexpr uint8_t chained = 0x80;  // Tag bit: the bucket has nodes after the first
+
+    // Fingerprint in 1..127 (0 marks an empty bucket), taken from hash bits
+    // below those used for the bucket index
+    static uint8_t fingerprint(uint64_t hash) {
+        uint8_t bits = uint8_t(hash >> 25) & 0x7f;
+        return bits ? bits : 1;
+    }
+
+    // Power-of-two bucket array indexed by the top bits of the hash, with one
+    // tag byte per bucket stored after the pointers in the same allocation
+    struct Table {
+        Table(unsigned bits, std::pmr::memory_resource* resource) : bits(bits), resource(resource) {
+            if (bits == 0) {
+                return;
+            }
+            if (resource) {
+                buckets = static_cast<Node**>(resource->allocate(bytes(), alignof(Node*)));
+                std::memset(buckets, 0, bytes());
+            } else {
+                buckets = static_cast<Node**>(std::calloc(size(), sizeof(Node*) + 1));
+                if (buckets == nullptr) {
+                    throw std::bad_alloc();
+                }
+            }
+            tags = reinterpret_cast<uint8_t*>(buckets + size());
+        }
+        Table(Table&& other) noexcept
+            : buckets(other.buckets), tags(other.tags), bits(other.bits), resource(other.resource) {
+            other.buckets = nullptr;
+            other.tags = nullptr;
+            other.bits = 0;
+        }
+        Table& operator=(Table&& other) noexcept {
+            std::swap(buckets, other.buckets);
+            std::swap(tags, other.tags);
+            std::swap(bits, other.bits);
+            std::swap(resource, other.resource);
+            return *this;
+        }
+        ~Table() {
+            if (resource == nullptr) {
+                std::free(buckets);
+            } else if (buckets) {
+                resource->deallocate(buckets, bytes(), alignof(Node*));
+            }
+        }
+
+        size_t size() const {
+            return bits ? size_t(1) << bits : 0;
+        }
+        size_t index(uint64_t hash) const {
+            return size_t(hash >> (64 - bits));
+        }
+        size_t bytes() const {
+            return size() * (sizeof(Node*) + 1);
+        }
+
+        // Recomputes a bucket's tag after its chain changed
+        void retag(size_t i) {
+            Node* head = buckets[i];
+            tags[i] = head ? uint8_t(fingerprint(head->hash) | (head->next ? chained : 0)) : 0;
+        }
+
+        Node** buckets = nullptr;
+        uint8_t* tags = nullptr;
+        unsigned bits;
+        std::pmr::memory_resource* resource;  // Null for calloc/free
+    };
+
+    // Allocation sizes as malloc rounds them; a resource is taken at its word
+    size_t footprint(size_t n) const {
+        return resource ? n : allocation_footprint(n);
+    }
+
+    Node* allocate_node(const KeyType& key, uint64_t hash) {
+        if (resource == nullptr) {
+            return new Node{key, MappedType(), nullptr, hash};
+        }
+        void* memory = resource->allocate(sizeof(Node), alignof(Node));
+        try {
+            return new (memory) Node{copy_key(key), MappedType(), nullptr, hash};
+        } catch (...) {
+            resource->deallocate(memory, sizeof(Node), alignof(Node));
+            throw;
+        }
+    }
+
+    void free_node(Node* node) {
+        if (resource == nullptr) {
+            delete node;
+        } else {
+            node->~Node();
+            resource->deallocate(node, sizeof(Node), alignof(Node));
+        }
+    }
+
+    // Copies a key into the resource if its type takes an allocator
+    KeyType copy_key(const KeyType& key) const {
+        typedef std::pmr::polymorphic_allocator<std::byte> Allocator;
+        if constexpr (std::uses_allocator<KeyType, Allocator>::value
+                      && std::is_constructible<KeyType, const KeyType&, const Allocator&>::value) {
+            return KeyType(key, Allocator(resource));
+        } else {
+            return key;
+        }
+    }
+
+    // The first node is only read if its fingerprint matches or the chain goes on
+    static Node* find_in(const Table& t, size_t i, const KeyType& key, uint64_t hash) {
+        uint8_t tag = t.tags[i];
+        if (tag == 0) {
+            return nullptr;
+        }
+        Node* node = t.buckets[i];
+        if ((tag & ~chained) == fingerprint(hash) && node->hash == hash && node->first == key) {
+            return node;
+        }
+        if (!(tag & chained)) {
+            return nullptr;
+        }
+        for (node = node->next; node; node = node->next) {
+            if (node->hash == hash && node->first == key) {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    static void link_front(Table& t, size_t i, Node* node) {
+        node->next = t.buckets[i];
+        t.buckets[i] = node;
+        t.tags[i] = fingerprint(node->hash) | (node->next ? chained : 0);
+    }
+
+    static Node** find_link(Node*& head, Node* node) {
+        for (Node** link = &head; *link; link = &(*link)->next) {
+            if (*link == node) {
+                return link;
+            }
+        }
+        return nullptr;
+    }
+
+    // Starts a new doubling; a still-running migration is finished first
+    void grow() {
+        while (old_table.buckets) {
+            migrate_some();
+        }
+        Table bigger(table.bits + 1, resource);
+        old_table = std::move(table);
+        table = std::move(bigger);
+        migrated = 0;
+    }
+
+    // Moves up to migrate_step chains from the old table into the current one
+    void migrate_some() {
+        if (old_table.buckets == nullptr) {
+            return;
+        }
+        for (size_t step = 0; step < migrate_step && migrated < old_table.size(); ++step, ++migrated) {
+            for (Node* node = old_table.buckets[migrated]; node;) {
+                Node* next = node->next;
+                link_front(table, table.index(node->hash), node);
+                node = next;
+            }
+        }
+        if (migrated == old_table.size()) {
+            old_table = Table(0, resource);
+        }
+    }
+
+    void free_chains(Table& t, size_t from) {
+        for (size_t i = from; i < t.size(); ++i) {
+            for (Node* node = t.buckets[i]; node;) {
+                Node* next = node->next;
+                free_node(node);
+                node = next;
+            }
+        }
+    }
+
+    std::pmr::memory_resource* resource;  // Null to use malloc directly
+    Table table;  // Receives all inserts
+    Table old_table;  // Being drained into table while a doubling is in progress
+    size_t migrated = 0;  // Old buckets below this index are already moved
+    size_t count = 0;
+};
+
+// Background thread that frees retired cache entries, so threads calling into
+// a cache never pay for destroying large values. One reclaimer can serve
+// several caches; batches still queued at destruction are freed before it returns.
+class Reclaimer {
+public:
+    Reclaimer() : worker([this] { run(); }) {}
+
+    ~Reclaimer() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        worker.join();
+    }
+
+    Reclaimer(const Reclaimer&) = delete;
+    Reclaimer& operator=(const Reclaimer&) = delete;
+
+    // Queues a batch; dropping the last reference to it is what frees it
+    void retire(std::shared_ptr<void> batch) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            pending.push_back(std::move(batch));
+            ++retired;
+        }
+        wakeup.notify_one();
+    }
+
+    // Function to wait until every batch retired so far has been freed. A no-op
+    // on the reclaimer's own thread, where a freed batch may itself call it.
+    void drain() {
+        if (std::this_thread::get_id() == worker.get_id()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        uint64_t target = retired;
+        drained.wait(lock, [this, target] { return freed >= target; });
+    }
+
+private:
+    void run() {
+        std::vector<std::shared_ptr<void>> batches;
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        for (;;) {
+            wakeup.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) {
+                return;  // Stopping and fully drained
+            }
+            batches.swap(pending);
+            lock.unlock();
+            size_t count = batches.size();
+            batches.clear();  // Destroy outside queue_mutex so retire() never waits on it
+            lock.lock();
+            freed += count;
+            drained.notify_all();
+        }
+    }
+
+    std::mutex queue_mutex;
+    std::condition_variable wakeup;
+    std::condition_variable drained;  // Signalled as batches are freed, for drain()
+    std::vector<std::shared_ptr<void>> pending;  // Batches waiting to be freed
+    uint64_t retired = 0;  // Batches queued so far
+    uint64_t freed = 0;  // Batches freed so far
+    bool stopping = false;
+    std::thread worker;  // Last, so it starts after the members above exist
+};
+
+template<typename KeyType, typename ValueType>
+class CacheSession;
+
+template<typename KeyType, typename ValueType>
+class LRUCache {
+public:
+    // Returns the heap bytes an entry owns beyond the cache's own nodes
+    typedef std::function<size_t(const KeyType&, const ValueType&)> Weigher;
+
+    // Constructor to init the cache w/ a given capacity; removed entries are
+    // freed by the reclaimer's thread if one is given, else by the caller after
+    // unlocking. Without a weigher, payload is measured with heap_usage().
+    explicit LRUCache(size_t size, std::shared_ptr<Reclaimer> reclaimer = nullptr, Weigher weigher = nullptr)
+        : LRUCache(size, nullptr, std::move(reclaimer), std::move(weigher)) {}
+
+    // Same, with list nodes and index storage taken from resource (keys and
+    // values that take an allocator, like std::pmr::string, are placed there
+    // too). Nodes are allocated before and freed after the cache's lock is
+    // held, so a resource shared between threads must be thread-safe (e.g.
+    // synchronized_pool_resource); a monotonic arena suits a single-threaded
+    // cache. The resource must outlive the cache. With a reclaimer, the
+    // destructor waits until the batches the cache retired have been freed,
+    // so none is freed into the resource after the cache is gone.
+    LRUCache(size_t size, std::pmr::memory_resource* resource, std::shared_ptr<Reclaimer> reclaimer = nullptr,
+             Weigher weigher = nullptr)
+        : capacity(size), reclaimer(std::move(reclaimer)), weigher(std::move(weigher)),
+          usage_list(resource ? resource : std::pmr::get_default_resource()), cache_map(resource) {}
+
+    ~LRUCache() {
+        if (reclaimer && usage_list.get_allocator().resource() != std::pmr::new_delete_resource()) {
+            reclaimer->drain();  // Retired nodes may still point into the resource
+        }
+    }
+
+    // Function to retrieve a value from the cache
+    ValueType get(const KeyType& key) {
+        auto lock = lock_cache(); // Lock for thread safety
+        auto it = touch(key, cache_map.hash_key(key), totals);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+        return it->second->second;  // Return the value associated with the key
+    }
+
+    // Function to retrieve a value w/o throwing, returns false on a miss
+    bool try_get(const KeyType& key, ValueType& value) {
+        auto lock = lock_cache(); // Lock for thread safety
+        auto it = touch(key, cache_map.hash_key(key), totals);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            return false;  // Key not found
+        }
+        value = it->second->second;  // Copy out the value associated with the key
+        return true;
+    }
+
+    // Function to insert or update a value in the cache
+    void put(const KeyType& key, const ValueType& value) {
+        Garbage garbage(this);  // Declared first so it's freed after unlocking
+        garbage.nodes.emplace_front(key, value);  // Build the new node before taking the lock
+        insert_front(garbage, cache_map.hash_key(key), totals);
+    }
+
+    // Function to remove an object from the cache if it exists, returns whether it did
+    bool erase(const KeyType& key) {
+        Garbage garbage(this);  // Freed after unlocking
+        return erase_hashed(key, cache_map.hash_key(key), garbage);
+    }
+
+    // Function to dynamically adjust the cache's capacity
+    void resize(size_t new_capacity) {
+        Garbage garbage(this);  // Freed after unlocking
+        auto lock = lock_cache(); // Lock to ensure thread safety
+        THREADSAFE_PROBE3(resize, this, capacity, new_capacity);
+        while (usage_list.size() > new_capacity) {  // If current size is larger than new capacity, reduce size
+            auto last = usage_list.end();
+            last--;
+            THREADSAFE_PROBE2(evict, this, &last->first);
+            evict(last, garbage, totals);  // Remove least recently used items
+        }
+        capacity = new_capacity;  // Set the new capacity
+    }
+
+    // Function to remember the last ~entries evicted keys (as hashes in a
+    // direct-mapped table, so approximately), counting misses on them as
+    // ghost hits: hits the cache would have had with that much more capacity.
+    // 0 turns tracking off. Resizing the table keeps the keys it remembers,
+    // short of collisions in a smaller one.
+    void track_evicted(size_t entries) {
+        std::vector<uint64_t> resized(entries, 0);  // Old table freed after unlocking
+        auto lock = lock_cache(); // Lock for thread safety
+        if (entries > 0) {
+            for (uint64_t ghost : ghosts) {
+                if (ghost != 0) {
+                    resized[(ghost >> 32) % entries] = ghost;
+                }
+            }
+        }
+        ghosts.swap(resized);
+    }
+
+    // Totals so far; operations through a CacheSession show up once it flushes
+    CacheCounters counters() {
+        auto lock = lock_cache(); // Lock for thread safety
+        return CacheCounters{totals.hits, totals.misses, totals.evictions, totals.ghost_hits,
+                             usage_list.size(), capacity};
+    }
+
+    // Function to open a per-thread handle for hot paths, see CacheSession; it must not outlive the cache
+    CacheSession<KeyType, ValueType> session() {
+        return CacheSession<KeyType, ValueType>(*this);
+    }
+
+    // Function to report memory held by the cache. Structure is computed from
+    // counts in O(1); payload is kept up to date as entries come and go.
+    MemoryUsage memory_usage() {
+        auto lock = lock_cache(); // Lock for thread safety
+        // A list node is two links plus the pair
+        size_t node_bytes = 2 * sizeof(void*) + sizeof(std::pair<KeyType, ValueType>);
+        if (cache_map.memory_resource() == nullptr) {
+            node_bytes = allocation_footprint(node_bytes);
+        }
+        return MemoryUsage{sizeof(*this) + usage_list.size() * node_bytes + cache_map.memory_usage(),
+                           payload_bytes.load(std::memory_order_relaxed)};
+    }
+
+private:
+    friend class CacheSession<KeyType, ValueType>;
+
+    typedef std::pmr::list<std::pair<KeyType, ValueType>> NodeList;
+    typedef IncrementalHashMap<KeyType, typename NodeList::iterator> Map;
+    typedef typename Map::iterator MapIterator;
+    typedef typename Map::Node IndexNode;
+
+    // Operation counts, kept by the cache and locally by each session
+    struct OpCounters {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t ghost_hits = 0;
+
+        void add(const OpCounters& other) {
+            hits += other.hits;
+            misses += other.misses;
+            evictions += other.evictions;
+            ghost_hits += other.ghost_hits;
+        }
+    };
+
+    // Nodes a session keeps for reuse: list nodes, and index nodes chained
+    // through next. Both keep their key's storage for the next put.
+    struct Spares {
+        explicit Spares(const typename NodeList::allocator_type& allocator) : nodes(allocator) {}
+
+        NodeList nodes;
+        IndexNode* index = nullptr;
+        size_t index_count = 0;
+    };
+
+    // Nodes unlinked during one operation. Declared before the lock, so they're
+    // destroyed (or handed to the reclaimer) only once cache_mutex is released
+    // and lock hold time doesn't depend on how expensive values are to free.
+    // Their payload is weighed and subtracted here too, off the lock.
+    // A session passes its spares, which take emptied nodes back for reuse;
+    // with a reclaimer, list nodes are retired with their values instead, so
+    // no value is destroyed on the caller's thread.
+    struct Garbage {
+        explicit Garbage(LRUCache* cache, Spares* spare = nullptr)
+            : nodes(cache->usage_list.get_allocator()), cache(cache), spare(spare) {}
+
+        ~Garbage() {
+            size_t weight = 0;
+            for (const auto& node : nodes) {
+                weight += cache->weigh(node);
+            }
+            cache->payload_bytes.fetch_sub(weight, std::memory_order_relaxed);
+            if constexpr (std::is_default_constructible<ValueType>::value) {
+                while (spare && !cache->reclaimer && !nodes.empty() && spare->nodes.size() < max_spare_nodes) {
+                    nodes.front().second = ValueType();  // Keeps the key's storage for the next put
+                    spare->nodes.splice(spare->nodes.end(), nodes, nodes.begin());
+                }
+            }
+            if (fresh) {
+                fresh->next = index;  // Unused: the put replaced an existing key
+                index = fresh;
+            }
+            while (index) {
+                IndexNode* node = index;
+                index = node->next;
+                if (spare && spare->index_count < max_spare_nodes) {
+                    node->next = spare->index;
+                    spare->index = node;
+                    ++spare->index_count;
+                } else {
+                    cache->cache_map.release_node(node);
+                }
+            }
+            if (cache->reclaimer && !nodes.empty()) {
+                try {
+                    cache->reclaimer->retire(std::make_shared<NodeList>(std::move(nodes)));
+                } catch (...) {
+                    // Out of memory for the hand-off, free the nodes here instead
+                }
+            }
+        }
+
+        // Moves a detached index node here, to be freed or recycled after unlocking
+        void add_index(IndexNode* node) {
+            node->next = index;
+            index = node;
+        }
+
+        NodeList nodes;
+        IndexNode* index = nullptr;  // Detached index nodes, chained through next
+        IndexNode* fresh = nullptr;  // Index node prepared for the key being put, if any
+        LRUCache* cache;
+        Spares* spare;
+    };
+
+    static constexpr size_t max_spare_nodes = 16;  // Per session, of each kind
+
+    // Looks a key up, counting into counters; a hit becomes MRU
+    MapIterator touch(const KeyType& key, uint64_t hash, OpCounters& counters) {
+        auto it = cache_map.find(key, hash);
+        if (it == cache_map.end()) {
+            THREADSAFE_PROBE2(get_miss, this, &key);
+            record_miss(hash, counters);
+            return it;
+        }
+        THREADSAFE_PROBE2(get_hit, this, &key);
+        ++counters.hits;
+        usage_list.splice(usage_list.begin(), usage_list, it->second); // Moves accessed node
+        return it;
+    }
+
+    // Makes the first node of garbage (a new key-value pair) the cache's MRU
+    // entry, replacing an old one with the same key or evicting the LRU entry.
+    // Removed nodes go to garbage, to be freed after the lock is released.
+    void insert_front(Garbage& garbage, uint64_t hash, OpCounters& counters) {
+        const KeyType& key = garbage.nodes.front().first;
+        size_t weight = weigh(garbage.nodes.front());
+        auto lock = lock_cache(); // Lock for thread safety
+        payload_bytes.fetch_add(weight, std::memory_order_relaxed);
+        auto it = cache_map.find(key, hash);  // Check if key already exists in the cache
+        if (it != cache_map.end()) {
+            // If key exists -> new node becomes MRU, old node and its value go to garbage
+            usage_list.splice(usage_list.begin(), garbage.nodes, garbage.nodes.begin());
+            garbage.nodes.splice(garbage.nodes.end(), usage_list, it->second);
+            it->second = usage_list.begin();
+            THREADSAFE_PROBE3(put, this, &usage_list.front().first, usage_list.size());
+            return;
+        }
+
+        if (capacity == 0) {
+            return;  // Nothing can be cached; the node stays in garbage
+        }
+
+        // If cache full, evict the LRU item
+        if (usage_list.size() == capacity) {
+            auto last = usage_list.end();
+            last--;
+            THREADSAFE_PROBE2(evict, this, &last->first);
+            evict(last, garbage, counters);
+        }
+
+        // Inserts the new key-value pair at the front of the list
+        usage_list.splice(usage_list.begin(), garbage.nodes, garbage.nodes.begin());
+        if (garbage.fresh) {
+            garbage.fresh->second = usage_list.begin();  // Key and hash were set before locking
+            cache_map.insert_node(garbage.fresh);
+            garbage.fresh = nullptr;
+        } else {
+            cache_map.find_or_insert(usage_list.front().first, hash) = usage_list.begin();
+        }
+        THREADSAFE_PROBE3(put, this, &usage_list.front().first, usage_list.size());
+    }
+
+    bool erase_hashed(const KeyType& key, uint64_t hash, Garbage& garbage) {
+        auto lock = lock_cache(); // Lock to ensure thread safety
+        auto it = cache_map.find(key, hash);  // Find the key in the map
+        if (it == cache_map.end()) {
+            return false;
+        }
+        garbage.nodes.splice(garbage.nodes.end(), usage_list, it->second);  // Remove from list
+        garbage.add_index(cache_map.detach(it));  // Remove from map
+        return true;
+    }
+
+    // Moves an entry to garbage; its cached hash also feeds the ghost table
+    void evict(typename NodeList::iterator entry, Garbage& garbage, OpCounters& counters) {
+        auto it = cache_map.find(entry->first);
+        record_eviction(it->hash, counters);
+        garbage.add_index(cache_map.detach(it));  // Remove from map
+        garbage.nodes.splice(garbage.nodes.end(), usage_list, entry);  // Remove from list
+    }
+
+    // Payload of one entry; the index holds a second copy of the key
+    size_t weigh(const std::pair<KeyType, ValueType>& node) const {
+        return weigher ? weigher(node.first, node.second) : 2 * heap_usage(node.first) + heap_usage(node.second);
+    }
+
+    // Ghost table entries are index hashes forced non-zero, so 0 marks an
+    // empty slot. They're placed by the hash's top bits, which Fibonacci
+    // hashing mixes best and the entry keeps, so a resized table can place
+    // them again.
+    void record_eviction(uint64_t hash, OpCounters& counters) {
+        ++counters.evictions;
+        if (!ghosts.empty()) {
+            ghosts[(hash >> 32) % ghosts.size()] = hash | 1;
+        }
+    }
+
+    void record_miss(uint64_t hash, OpCounters& counters) {
+        ++counters.misses;
+        if (!ghosts.empty()) {
+            uint64_t& slot = ghosts[(hash >> 32) % ghosts.size()];
+            if (slot == (hash | 1)) {
+                ++counters.ghost_hits;
+                slot = 0;  // Count each eviction once
+            }
+        }
+    }
+
+    // Takes cache_mutex, firing the contention probes only if it had to wait
+    std::unique_lock<std::mutex> lock_cache() {
+        std::unique_lock<std::mutex> lock(cache_mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            THREADSAFE_PROBE1(lock_contended, this);
+            lock.lock();
+            THREADSAFE_PROBE1(lock_acquired, this);
+        }
+        return lock;
+    }
+
+    size_t capacity;  // Maximum number of elements in the cache
+    std::shared_ptr<Reclaimer> reclaimer;  // Optional, frees removed entries off the caller's thread
+    Weigher weigher;  // Optional, replaces heap_usage() for payload accounting
+    std::atomic<size_t> payload_bytes{0};  // Sum of weigh() over cached entries and unfreed garbage
+    OpCounters totals;  // Reported by counters()
+    std::vector<uint64_t> ghosts;  // Hashes of recently evicted keys, empty unless tracked
+    // List to track the least recent to most recently used objects
+    NodeList usage_list;  
+    // Map to quickly lookup elements in the list; grows incrementally so no put pays for a full rehash
+    IncrementalHashMap<KeyType, typename NodeList::iterator> cache_map;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// Per-thread handle onto an LRUCache for hot paths. It owns the scratch state
+// each call would otherwise rebuild or share with other threads: the current
+// key and its hash, operation counters that reach the cache every
+// flush_interval operations instead of on each one, and up to
+// max_spare_nodes list nodes and as many index nodes recycled from replaced,
+// evicted or erased entries, keys' storage included. Once a session has
+// spares, a steady stream of puts allocates nothing but the value copies and
+// the index's occasional doubling. With a reclaimer, list nodes go to it with
+// their values rather than being recycled, so puts allocate those again.
+// Keep one session per thread, as a local in a worker loop or a thread_local,
+// which flushes when the thread exits; it must not outlive its cache.
+//   auto session = cache.session();
+//   session.set_key(request.key);
+//   if (!session.try_get(value)) { value = load(request.key); session.put(value); }
+template<typename KeyType, typename ValueType>
+class CacheSession {
+public:
+    static constexpr unsigned flush_interval = 64;  // Operations between counter flushes
+
+    explicit CacheSession(LRUCache<KeyType, ValueType>& cache)
+        : cache(&cache), spare(cache.usage_list.get_allocator()) {}
+
+    CacheSession(CacheSession&& other)
+        : cache(other.cache), key(std::move(other.key)), hash(other.hash), pending(other.pending),
+          unflushed(other.unflushed), spare(std::move(other.spare)) {
+        other.pending = Counters();
+        other.unflushed = 0;
+        other.spare.index = nullptr;
+        other.spare.index_count = 0;
+    }
+
+    CacheSession(const CacheSession&) = delete;
+    CacheSession& operator=(const CacheSession&) = delete;
+
+    ~CacheSession() {
+        flush();
+        while (spare.index) {
+            auto* node = spare.index;
+            spare.index = node->next;
+            cache->cache_map.release_node(node);
+        }
+    }
+
+    // Function to set the key the following operations apply to; reuses the buffer's storage
+    void set_key(const KeyType& source) {
+        if (key) {
+            *key = source;
+        } else {
+            key.emplace(source);
+        }
+        hash = Map::hash_key(*key);
+    }
+
+    const KeyType& current_key() const {
+        return checked_key();
+    }
+
+    // Function to retrieve the current key's value w/o throwing, returns false on a miss
+    bool try_get(ValueType& value) {
+        const KeyType& k = checked_key();
+        auto lock = cache->lock_cache(); // Lock for thread safety
+        auto it = cache->touch(k, hash, pending);
+        if (++unflushed >= flush_interval) {
+            drain();  // Already under the cache lock
+        }
+        if (it == cache->cache_map.end()) {
+            return false;  // Key not found
+        }
+        value = it->second->second;  // Copy out the value associated with the key
+        return true;
+    }
+
+    // Function to retrieve the current key's value
+    ValueType get() {
+        const KeyType& k = checked_key();
+        auto lock = cache->lock_cache(); // Lock for thread safety
+        auto it = cache->touch(k, hash, pending);
+        if (++unflushed >= flush_interval) {
+            drain();  // Already under the cache lock
+        }
+        if (it == cache->cache_map.end()) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+        return it->second->second;  // Return the value associated with the key
+    }
+
+    // Function to insert or update the current key's value
+    void put(const ValueType& value) {
+        const KeyType& k = checked_key();
+        typename Cache::Garbage garbage(cache, &spare);  // Declared first so it's freed after unlocking
+        if (spare.nodes.empty()) {
+            garbage.nodes.emplace_front(k, value);
+        } else {
+            spare.nodes.front().first = k;  // Copies into the recycled key's storage
+            spare.nodes.front().second = value;
+            garbage.nodes.splice(garbage.nodes.begin(), spare.nodes, spare.nodes.begin());
+        }
+        if (spare.index) {
+            garbage.fresh = spare.index;  // Used if the key is new, else handed back
+            spare.index = garbage.fresh->next;
+            --spare.index_count;
+            garbage.fresh->first = k;
+            garbage.fresh->hash = hash;
+        }
+        cache->insert_front(garbage, hash, pending);
+        if (++unflushed >= flush_interval) {
+            flush();
+        }
+    }
+
+    // Function to remove the current key from the cache
+    bool erase() {
+        const KeyType& k = checked_key();
+        typename Cache::Garbage garbage(cache, &spare);  // Freed after unlocking
+        return cache->erase_hashed(k, hash, garbage);
+    }
+
+    bool try_get(const KeyType& k, ValueType& value) {
+        set_key(k);
+        return try_get(value);
+    }
+
+    ValueType get(const KeyType& k) {
+        set_key(k);
+        return get();
+    }
+
+    void put(const KeyType& k, const ValueType& value) {
+        set_key(k);
+        put(value);
+    }
+
+    bool erase(const KeyType& k) {
+        set_key(k);
+        return erase();
+    }
+
+    // Function to add this session's pending counts to the cache's counters()
+    void flush() {
+        if (unflushed == 0) {
+            return;
+        }
+        auto lock = cache->lock_cache();
+        drain();
+    }
+
+private:
+    typedef LRUCache<KeyType, ValueType> Cache;
+    typedef typename Cache::Map Map;
+    typedef typename Cache::OpCounters Counters;
+
+    const KeyType& checked_key() const {
+        if (!key) {
+            throw std::logic_error("CacheSession has no key set");
+        }
+        return *key;
+    }
+
+    // Caller holds the cache lock
+    void drain() {
+        cache->totals.add(pending);
+        pending = Counters();
+        unflushed = 0;
+    }
+
+    Cache* cache;
+    std::optional<KeyType> key;  // Key buffer, kept across set_key() calls
+    uint64_t hash = 0;  // cache_map's hash of key
+    Counters pending;  // Not yet added to the cache's totals
+    unsigned unflushed = 0;  // Operations since the last flush
+    typename Cache::Spares spare;  // Recycled nodes, from the cache's allocators
+};
+
+// Key domain marker selecting the direct-indexed LRUCache specialization:
+// keys are integers in [0, Limit), e.g. LRUCache<DenseKeys<uint32_t, (1u << 28)>, Entity>
+template<typename IntType, IntType Limit>
+struct DenseKeys {
+    static_assert(std::is_integral<IntType>::value && Limit > 0, "DenseKeys needs a positive integer domain");
+};
+
+// LRUCache over a dense integer key domain. cache_map is replaced by a
+// two-level paged array from key to node slot, so a lookup is two array reads
+// with no hashing or probing. Pages of 4096 slots are allocated when the
+// first key in them is inserted and freed when their last key leaves, so
+// memory follows the populated key ranges rather than the whole domain. As in
+// LRUCache, values are copied in and replaced or removed ones destroyed
+// outside the lock: slots swap them with locals declared before it.
+template<typename IntType, IntType Limit, typename ValueType>
+class LRUCache<DenseKeys<IntType, Limit>, ValueType> {
+public:
+    typedef IntType KeyType;
+
+    // Constructor to init the cache w/ a given capacity
+    explicit LRUCache(size_t size) : capacity(size), pages(page_of(Limit - 1) + 1) {}
+
+    // Function to retrieve a value from the cache
+    ValueType get(const KeyType& key) {
+        auto lock = lock_cache(); // Lock for thread safety
+        uint32_t slot = lookup(key);
+        if (slot == nil) {
+            THREADSAFE_PROBE2(get_miss, this, &key);
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+
+        THREADSAFE_PROBE2(get_hit, this, &key);
+        move_to_front(slot); // Moves accessed node
+        return nodes[slot].value;  // Return the value associated with the key
+    }
+
+    // Function to retrieve a value w/o throwing, returns false on a miss
+    bool try_get(const KeyType& key, ValueType& value) {
+        auto lock = lock_cache(); // Lock for thread safety
+        uint32_t slot = lookup(key);
+        if (slot == nil) {
+            THREADSAFE_PROBE2(get_miss, this, &key);
+            return false;  // Key not found
+        }
+
+        THREADSAFE_PROBE2(get_hit, this, &key);
+        move_to_front(slot); // Moves accessed node
+        value = nodes[slot].value;  // Copy out the value associated with the key
+        return true;
+    }
+
+    // Function to insert or update a value in the cache
+    void put(const KeyType& key, const ValueType& value) {
+        if (!in_domain(key)) {
+            throw std::out_of_range("Key outside the DenseKeys domain");
+        }
+        ValueType incoming(value);  // Ends up holding the replaced value, if any
+        ValueType evicted{};
+        auto lock = lock_cache(); // Lock for thread safety
+        using std::swap;
+        uint32_t slot = lookup(key);
+        if (slot != nil) {
+            move_to_front(slot);  // If key exists -> MRU
+            swap(nodes[slot].value, incoming);  // Update the value
+            THREADSAFE_PROBE3(put, this, &key, count);
+            return;
+        }
+
+        if (capacity == 0) {
+            return;  // Nothing can be stored
+        }
+
+        // If cache full, evict the LRU item
+        if (count >= capacity) {
+            THREADSAFE_PROBE2(evict, this, &nodes[tail].key);
+            remove(tail, evicted);
+        }
+
+        // Reuse a free node slot, or grow the node array
+        if (free_head != nil) {
+            slot = free_head;
+            free_head = nodes[slot].next;
+            nodes[slot].key = key;
+            swap(nodes[slot].value, incoming);  // Free slots hold empty values
+        } else {
+            slot = uint32_t(nodes.size());
+            nodes.push_back(Node{key, nil, nil, std::move(incoming)});
+        }
+        link(key, slot);
+        push_front(slot);
+        ++count;
+        THREADSAFE_PROBE3(put, this, &key, count);
+    }
+
+    // Function to remove an object from the cache if it exists, returns whether it did
+    bool erase(const KeyType& key) {
+        ValueType removed{};  // Destroyed after unlocking
+        auto lock = lock_cache(); // Lock to ensure thread safety
+        uint32_t slot = lookup(key);
+        if (slot == nil) {
+            return false;
+        }
+        remove(slot, removed);
+        return true;
+    }
+
+    // Function to dynamically adjust the cache's capacity
+    void resize(size_t new_capacity) {
+        std::vector<ValueType> removed;  // Destroyed after unlocking
+        auto lock = lock_cache(); // Lock to ensure thread safety
+        THREADSAFE_PROBE3(resize, this, capacity, new_capacity);
+        removed.reserve(count > new_capacity ? count - new_capacity : 0);
+        while (count > new_capacity) {  // If current size is larger than new capacity, reduce size
+            THREADSAFE_PROBE2(evict, this, &nodes[tail].key);
+            removed.emplace_back();
+            remove(tail, removed.back());
+        }
+        capacity = new_capacity;  // Set the new capacity
+    }
+
+private:
+    static constexpr uint32_t nil = UINT32_MAX;
+    static constexpr size_t page_bits = 12;
+    static constexpr size_t page_size = size_t(1) << page_bits;
+
+    struct Node {
+        KeyType key;
+        uint32_t prev;  // Towards the MRU end
+        uint32_t next;  // Towards the LRU end; also links free slots
+        ValueType value;
+    };
+
+    // Second-level page: node slot per key, nil when absent
+    struct Page {
+        Page() { std::fill(std::begin(slots), std::end(slots), nil); }
+        uint32_t slots[page_size];
+        size_t used = 0;
+    };
+
+    static size_t page_of(KeyType key) {
+        return size_t(key) >> page_bits;
+    }
+
+    static bool in_domain(KeyType key) {
+        return !(key < KeyType(0)) && key < Limit;
+    }
+
+    uint32_t lookup(KeyType key) const {
+        if (!in_domain(key)) {
+            return nil;
+        }
+        const Page* page = pages[page_of(key)].get();
+        return page ? page->slots[size_t(key) & (page_size - 1)] : nil;
+    }
+
+    void link(KeyType key, uint32_t slot) {
+        std::unique_ptr<Page>& page = pages[page_of(key)];
+        if (!page) {
+            page.reset(new Page());
+        }
+        page->slots[size_t(key) & (page_size - 1)] = slot;
+        ++page->used;
+    }
+
+    // Unlinks a node from its page and the recency list and frees its slot,
+    // swapping its value with released (an empty one) for the caller to destroy
+    void remove(uint32_t slot, ValueType& released) {
+        KeyType key = nodes[slot].key;
+        std::unique_ptr<Page>& page = pages[page_of(key)];
+        page->slots[size_t(key) & (page_size - 1)] = nil;
+        if (--page->used == 0) {
+            page.reset();
+        }
+        unlink(slot);
+        using std::swap;
+        swap(nodes[slot].value, released);
+        nodes[slot].next = free_head;
+        free_head = slot;
+        --count;
+    }
+
+    void unlink(uint32_t slot) {
+        Node& node = nodes[slot];
+        (node.prev == nil ? head : nodes[node.prev].next) = node.next;
+        (node.next == nil ? tail : nodes[node.next].prev) = node.prev;
+    }
+
+    void push_front(uint32_t slot) {
+        nodes[slot].prev = nil;
+        nodes[slot].next = head;
+        (head == nil ? tail : nodes[head].prev) = slot;
+        head = slot;
+    }
+
+    void move_to_front(uint32_t slot) {
+        if (slot != head) {
+            unlink(slot);
+            push_front(slot);
+        }
+    }
+
+    // Takes cache_mutex, firing the contention probes only if it had to wait
+    std::unique_lock<std::mutex> lock_cache() {
+        std::unique_lock<std::mutex> lock(cache_mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            THREADSAFE_PROBE1(lock_contended, this);
+            lock.lock();
+            THREADSAFE_PROBE1(lock_acquired, this);
+        }
+        return lock;
+    }
+
+    size_t capacity;  // Maximum number of elements in the cache
+    size_t count = 0;  // Elements currently cached
+    // Node slots with the recency list threaded through them, MRU at head
+    std::vector<Node> nodes;
+    uint32_t head = nil;
+    uint32_t tail = nil;
+    uint32_t free_head = nil;
+    // First-level directory of key pages
+    std::vector<std::unique_ptr<Page>> pages;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// LFU cache with O(1) get/put: entries live in per-frequency buckets kept in
+// ascending order, so the victim is always the LRU entry of the first bucket.
+// With a non-zero decay_interval all frequencies are halved every
+// decay_interval operations, letting popularity from old epochs fade.
+template<typename KeyType, typename ValueType>
+class LFUCache {
+public:
+    // Constructor to init the cache w/ a given capacity (decay_interval 0 disables aging)
+    explicit LFUCache(size_t size, size_t decay_interval = 0)
+        : capacity(size), decay_interval(decay_interval) {}
+
+    // Function to retrieve a value from the cache
+    ValueType get(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+
+        touch(it->second);  // Bump the entry into the next frequency bucket
+        ValueType value = it->second.entry->second;
+        tick();
+        return value;
+    }
+
+    // Function to insert or update a value in the cache
+    void put(const KeyType& key, const ValueType& value) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Check if key already exists in the cache
+        if (it != cache_map.end()) {
+            it->second.entry->second = value;  // Update the value
+            touch(it->second);
+            tick();
+            return;
+        }
+
+        if (capacity == 0) {
+            return;  // Nothing can be stored
+        }
+
+        // If cache full, evict the LRU item of the least frequent bucket
+        if (cache_map.size() >= capacity) {
+            evict();
+        }
+
+        // New entries start in the frequency 1 bucket
+        if (buckets.empty() || buckets.front().frequency != 1) {
+            buckets.emplace_front(1);
+        }
+        auto bucket = buckets.begin();
+        bucket->entries.emplace_front(key, value);
+        cache_map[key] = Locator{bucket, bucket->entries.begin()};
+        tick();
+    }
+
+    // Function to remove an object from the cache if it exists
+    void erase(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        auto it = cache_map.find(key);  // Find the key in the map
+        if (it != cache_map.end()) {
+            auto bucket = it->second.bucket;
+            bucket->entries.erase(it->second.entry);  // Remove from bucket
+            if (bucket->entries.empty()) {
+                buckets.erase(bucket);
+            }
+            cache_map.erase(it);  // Remove from map
+        }
+    }
+
+    // Function to dynamically adjust the cache's capacity
+    void resize(size_t new_capacity) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        while (cache_map.size() > new_capacity) {  // Evict least frequently used items
+            evict();
+        }
+        capacity = new_capacity;  // Set the new capacity
+    }
+
+private:
+    typedef std::list<std::pair<KeyType, ValueType>> EntryList;
+
+    // All entries sharing one access count, most recently used at the front
+    struct Bucket {
+        explicit Bucket(size_t f) : frequency(f) {}
+        size_t frequency;
+        EntryList entries;
+    };
+    typedef typename std::list<Bucket>::iterator BucketIterator;
+
+    // Where a key currently lives: its bucket and its node in that bucket
+    struct Locator {
+        BucketIterator bucket;
+        typename EntryList::iterator entry;
+    };
+
+    // Moves an entry from its bucket to the front of the frequency + 1 bucket
+    void touch(Locator& loc) {
+        auto bucket = loc.bucket;
+        auto next = std::next(bucket);
+        if (next == buckets.end() || next->frequency != bucket->frequency + 1) {
+            next = buckets.emplace(next, bucket->frequency + 1);
+        }
+        next->entries.splice(next->entries.begin(), bucket->entries, loc.entry);
+        if (bucket->entries.empty()) {
+            buckets.erase(bucket);
+        }
+        loc.bucket = next;
+    }
+
+    // Removes the least recently used entry of the least frequent bucket
+    void evict() {
+        auto bucket = buckets.begin();
+        cache_map.erase(bucket->entries.back().first);  // Remove from map
+        bucket->entries.pop_back();  // Remove from bucket
+        if (bucket->entries.empty()) {
+            buckets.erase(bucket);
+        }
+    }
+
+    // Counts an operation and ages all frequencies once per decay_interval
+    void tick() {
+        if (decay_interval == 0 || ++operations < decay_interval) {
+            return;
+        }
+        operations = 0;
+
+        // Halving keeps buckets sorted; buckets that collide are merged, with
+        // the formerly hotter entries placed on the MRU side
+        for (auto bucket = buckets.begin(); bucket != buckets.end();) {
+            bucket->frequency = std::max<size_t>(1, bucket->frequency / 2);
+            if (bucket == buckets.begin() || std::prev(bucket)->frequency != bucket->frequency) {
+                ++bucket;
+                continue;
+            }
+            auto prev = std::prev(bucket);
+            for (auto& entry : bucket->entries) {
+                cache_map[entry.first].bucket = prev;
+            }
+            prev->entries.splice(prev->entries.begin(), bucket->entries);
+            bucket = buckets.erase(bucket);
+        }
+    }
+
+    size_t capacity;  // Maximum number of elements in the cache
+    size_t decay_interval;  // Operations between frequency halvings (0 = never)
+    size_t operations = 0;  // Operations since the last halving
+    // Frequency buckets in ascending order of access count
+    std::list<Bucket> buckets;
+    // Map to quickly lookup elements in the buckets
+    std::unordered_map<KeyType, Locator> cache_map;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// LIRS cache: resident entries are split into LIR (low inter-reference
+// recency) entries, which are never evicted directly, and a small set of
+// resident HIR entries queued for eviction. The recency stack also remembers
+// a bounded number of non-resident HIR keys, so a key that comes back soon
+// after eviction is promoted to LIR; loops larger than the cache keep hitting.
+template<typename KeyType, typename ValueType>
+class LIRSCache {
+public:
+    // Constructor to init the cache w/ a given capacity
+    explicit LIRSCache(size_t size) { set_capacity(size); }
+
+    // Function to retrieve a value from the cache
+    ValueType get(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Attempt to find the key in the hash map
+        if (it == cache_map.end() || !it->second.value) {
+            throw std::range_error("Key not found");  // Missing or non-resident, throw exception
+        }
+
+        access(&*it);
+        return *it->second.value;  // Return the value associated with the key
+    }
+
+    // Function to insert or update a value in the cache
+    void put(const KeyType& key, const ValueType& value) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Check if key already exists in the cache
+        if (it != cache_map.end() && it->second.value) {
+            *it->second.value = value;  // Update the value
+            access(&*it);
+            return;
+        }
+
+        if (capacity == 0) {
+            return;  // Nothing can be stored
+        }
+
+        // Make room first; this may drop the key's own non-resident record
+        if (resident_count >= capacity) {
+            evict();
+        }
+
+        it = cache_map.find(key);
+        if (it == cache_map.end()) {
+            it = cache_map.emplace(key, Entry()).first;
+        }
+        Node* node = &*it;
+        Entry& entry = node->second;
+        entry.value = value;
+        ++resident_count;
+
+        if (entry.in_stack) {
+            // Non-resident HIR key with a short reuse distance becomes LIR
+            nonresident_list.erase(entry.nonresident_pos);
+            stack.splice(stack.begin(), stack, entry.stack_pos);
+            entry.lir = true;
+            ++lir_count;
+            while (lir_count > lir_capacity) {
+                demote_bottom();
+            }
+        } else if (lir_count < lir_capacity) {
+            push_stack(node);  // Warm-up: fill the LIR set first
+            entry.lir = true;
+            ++lir_count;
+        } else {
+            push_stack(node);
+            push_queue(node);
+        }
+    }
+
+    // Function to remove an object from the cache if it exists
+    void erase(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        auto it = cache_map.find(key);  // Find the key in the map
+        if (it == cache_map.end()) {
+            return;
+        }
+
+        Entry& entry = it->second;
+        if (entry.in_stack) {
+            stack.erase(entry.stack_pos);
+        }
+        if (!entry.value) {
+            nonresident_list.erase(entry.nonresident_pos);
+        } else {
+            --resident_count;
+            if (entry.lir) {
+                --lir_count;
+            } else {
+                queue.erase(entry.queue_pos);
+            }
+        }
+        cache_map.erase(it);  // Remove from map
+        prune();
+    }
+
+    // Function to dynamically adjust the cache's capacity
+    void resize(size_t new_capacity) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        set_capacity(new_capacity);
+        while (lir_count > lir_capacity) {
+            demote_bottom();
+        }
+        while (resident_count > capacity) {
+            evict();
+        }
+        while (nonresident_list.size() > capacity) {
+            drop_oldest_nonresident();
+        }
+    }
+
+private:
+    struct Entry;
+    typedef std::pair<const KeyType, Entry> Node;
+    typedef typename std::list<Node*>::iterator NodeIterator;
+
+    struct Entry {
+        std::optional<ValueType> value;  // Empty for non-resident HIR keys
+        bool lir = false;
+        bool in_stack = false;
+        NodeIterator stack_pos;  // Valid while in_stack
+        NodeIterator queue_pos;  // Valid while resident HIR
+        NodeIterator nonresident_pos;  // Valid while non-resident
+    };
+
+    // Splits capacity into the LIR set and ~1% resident HIR slots
+    void set_capacity(size_t size) {
+        capacity = size;
+        size_t hir_capacity = std::max<size_t>(1, size / 100);
+        lir_capacity = size > hir_capacity ? size - hir_capacity : std::min<size_t>(size, 1);
+    }
+
+    // Applies the LIRS rules for a hit on a resident entry
+    void access(Node* node) {
+        Entry& entry = node->second;
+        if (entry.lir) {
+            bool was_bottom = stack.back() == node;
+            stack.splice(stack.begin(), stack, entry.stack_pos);
+            if (was_bottom) {
+                prune();
+            }
+        } else if (entry.in_stack) {
+            // Resident HIR reused within the stack: promote to LIR
+            stack.splice(stack.begin(), stack, entry.stack_pos);
+            queue.erase(entry.queue_pos);
+            entry.lir = true;
+            ++lir_count;
+            while (lir_count > lir_capacity) {
+                demote_bottom();
+            }
+        } else {
+            push_stack(node);
+            queue.splice(queue.begin(), queue, entry.queue_pos);
+        }
+    }
+
+    void push_stack(Node* node) {
+        stack.push_front(node);
+        node->second.stack_pos = stack.begin();
+        node->second.in_stack = true;
+    }
+
+    void push_queue(Node* node) {
+        queue.push_front(node);
+        node->second.queue_pos = queue.begin();
+    }
+
+    // Turns the LIR entry at the stack bottom into a resident HIR entry
+    void demote_bottom() {
+        Node* node = stack.back();
+        stack.pop_back();
+        node->second.in_stack = false;
+        node->second.lir = false;
+        --lir_count;
+        push_queue(node);
+        prune();
+    }
+
+    // Stack pruning: the bottom of the stack must always be an LIR entry
+    void prune() {
+        while (!stack.empty() && !stack.back()->second.lir) {
+            Node* node = stack.back();
+            stack.pop_back();
+            node->second.in_stack = false;
+            if (!node->second.value) {
+                nonresident_list.erase(node->second.nonresident_pos);
+                cache_map.erase(cache_map.find(node->first));
+            }
+        }
+    }
+
+    // Evicts the least recently used resident HIR entry
+    void evict() {
+        if (queue.empty()) {
+            demote_bottom();
+        }
+        Node* node = queue.back();
+        queue.pop_back();
+        --resident_count;
+        if (!node->second.in_stack) {
+            cache_map.erase(cache_map.find(node->first));  // No history worth keeping
+            return;
+        }
+
+        // Keep the key as non-resident HIR, bounded to capacity such records
+        node->second.value.reset();
+        nonresident_list.push_front(node);
+        node->second.nonresident_pos = nonresident_list.begin();
+        if (nonresident_list.size() > capacity) {
+            drop_oldest_nonresident();
+        }
+    }
+
+    void drop_oldest_nonresident() {
+        Node* node = nonresident_list.back();
+        nonresident_list.pop_back();
+        stack.erase(node->second.stack_pos);
+        cache_map.erase(cache_map.find(node->first));
+    }
+
+    size_t capacity;  // Maximum number of resident elements in the cache
+    size_t lir_capacity;  // Resident slots reserved for LIR entries
+    size_t lir_count = 0;
+    size_t resident_count = 0;
+    // Recency stack S: LIR, resident HIR and non-resident HIR keys, MRU at the front
+    std::list<Node*> stack;
+    // List Q of resident HIR entries, eviction from the back
+    std::list<Node*> queue;
+    // Non-resident HIR keys still in the stack, oldest at the back
+    std::list<Node*> nonresident_list;
+    // Map owning every tracked key; node addresses stay stable across rehashes
+    std::unordered_map<KeyType, Entry> cache_map;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// LRU-K cache: the victim is the entry whose K-th most recent reference is
+// oldest, i.e. with the largest backward K-distance. Entries referenced fewer
+// than K times have infinite distance and go first, in LRU order, so a scan
+// cannot push out keys that were referenced repeatedly. Reference history of
+// evicted keys is retained in a bounded table and restored if they return.
+template<typename KeyType, typename ValueType>
+class LRUKCache {
+public:
+    // Constructor to init the cache w/ a given capacity, K and retained history size
+    explicit LRUKCache(size_t size, size_t k = 2, size_t history_size = 0)
+        : capacity(size), k(std::max<size_t>(1, k)), history_capacity(history_size ? history_size : size) {}
+
+    // Function to retrieve a value from the cache
+    ValueType get(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+
+        reference(*it);
+        return it->second.value;  // Return the value associated with the key
+    }
+
+    // Function to insert or update a value in the cache
+    void put(const KeyType& key, const ValueType& value) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Check if key already exists in the cache
+        if (it != cache_map.end()) {
+            it->second.value = value;  // Update the value
+            reference(*it);
+            return;
+        }
+
+        if (capacity == 0) {
+            return;  // Nothing can be stored
+        }
+
+        // If cache full, evict the entry with the largest backward K-distance
+        if (cache_map.size() >= capacity) {
+            evict();
+        }
+
+        it = cache_map.emplace(key, Entry{value, std::vector<uint64_t>(k, 0), order.end()}).first;
+        auto retained = history_map.find(key);  // Restore history of a returning key
+        if (retained != history_map.end()) {
+            it->second.history.swap(retained->second.history);
+            history_list.erase(retained->second.pos);
+            history_map.erase(retained);
+        }
+        reference(*it);
+    }
+
+    // Function to remove an object from the cache if it exists
+    void erase(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        auto it = cache_map.find(key);  // Find the key in the map
+        if (it != cache_map.end()) {
+            order.erase(it->second.order_pos);  // Remove from eviction order
+            cache_map.erase(it);  // Remove from map
+        }
+        auto retained = history_map.find(key);  // An explicit erase forgets the history too
+        if (retained != history_map.end()) {
+            history_list.erase(retained->second.pos);
+            history_map.erase(retained);
+        }
+    }
+
+    // Function to dynamically adjust the cache's capacity
+    void resize(size_t new_capacity) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        while (cache_map.size() > new_capacity) {  // Evict by backward K-distance
+            evict();
+        }
+        capacity = new_capacity;  // Set the new capacity
+    }
+
+private:
+    // Eviction priority: K-th most recent reference time (0 if fewer than K), then last reference
+    typedef std::pair<uint64_t, uint64_t> Priority;
+
+    struct Entry {
+        ValueType value;
+        std::vector<uint64_t> history;  // Last K reference times, newest first, 0 = none
+        typename std::map<Priority, const KeyType*>::iterator order_pos;
+    };
+
+    struct Retained {
+        std::vector<uint64_t> history;
+        typename std::list<KeyType>::iterator pos;
+    };
+
+    // Records a reference and re-files the entry under its new priority
+    void reference(std::pair<const KeyType, Entry>& node) {
+        Entry& entry = node.second;
+        if (entry.order_pos != order.end()) {
+            order.erase(entry.order_pos);
+        }
+        std::copy_backward(entry.history.begin(), entry.history.end() - 1, entry.history.end());
+        entry.history[0] = ++clock;
+        entry.order_pos = order.emplace(Priority(entry.history[k - 1], clock), &node.first).first;
+    }
+
+    // Evicts the entry with the oldest K-th reference and retains its history
+    void evict() {
+        auto victim = cache_map.find(*order.begin()->second);
+        order.erase(order.begin());
+
+        history_list.push_front(victim->first);
+        history_map[victim->first] = Retained{std::move(victim->second.history), history_list.begin()};
+        if (history_list.size() > history_capacity) {
+            history_map.erase(history_list.back());
+            history_list.pop_back();
+        }
+        cache_map.erase(victim);  // Remove from map
+    }
+
+    size_t capacity;  // Maximum number of elements in the cache
+    size_t k;  // Which most recent reference decides eviction
+    size_t history_capacity;  // Maximum number of evicted keys whose history is kept
+    uint64_t clock = 0;  // Logical time, advanced on every reference
+    // Entries ordered by eviction priority, victim at the front
+    std::map<Priority, const KeyType*> order;
+    // Map holding the cached entries
+    std::unordered_map<KeyType, Entry> cache_map;
+    // Retained history of recently evicted keys, most recently evicted at the front
+    std::list<KeyType> history_list;
+    std::unordered_map<KeyType, Retained> history_map;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// Windowed LRU cache: new entries land in a small admission-window LRU and
+// graduate into a segmented main region (probation + protected) when pushed
+// out of the window. A hill climber samples the hit ratio periodically and
+// moves capacity between window and main in whichever direction improved it,
+// with a decaying step that restarts when the hit ratio shifts sharply.
+template<typename KeyType, typename ValueType>
+class WindowLRUCache {
+public:
+    // Constructor to init the cache w/ a given capacity, starting with a 1% window
+    explicit WindowLRUCache(size_t size)
+        : capacity(size), window_capacity(std::max<size_t>(1, size / 100)) {
+        step = initial_step();
+        set_regions();
+    }
+
+    // Function to retrieve a value from the cache
+    ValueType get(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            sample(false);
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+
+        touch(it->second);
+        ValueType value = it->second->value;
+        sample(true);
+        return value;
+    }
+
+    // Function to insert or update a value in the cache
+    void put(const KeyType& key, const ValueType& value) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Check if key already exists in the cache
+        if (it != cache_map.end()) {
+            it->second->value = value;  // Update the value
+            touch(it->second);
+            return;
+        }
+
+        if (capacity == 0) {
+            return;  // Nothing can be stored
+        }
+
+        // New entries always enter through the window
+        window.push_front(Node{key, value, WINDOW});
+        cache_map[key] = window.begin();
+        rebalance();
+    }
+
+    // Function to remove an object from the cache if it exists
+    void erase(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        auto it = cache_map.find(key);  // Find the key in the map
+        if (it != cache_map.end()) {
+            region(it->second->region).erase(it->second);  // Remove from list
+            cache_map.erase(it);  // Remove from map
+        }
+    }
+
+    // Function to dynamically adjust the cache's capacity, keeping the window share
+    void resize(size_t new_capacity) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        double share = capacity ? double(window_capacity) / capacity : 0.01;
+        capacity = new_capacity;
+        window_capacity = size_t(share * new_capacity + 0.5);
+        step = initial_step();
+        set_regions();
+        rebalance();
+    }
+
+private:
+    enum Region { WINDOW, PROBATION, PROTECTED };
+
+    struct Node {
+        KeyType key;
+        ValueType value;
+        Region region;
+    };
+    typedef std::list<Node> NodeList;
+
+    static constexpr double step_percent = 0.0625;  // Initial step as a share of capacity
+    static constexpr double step_decay = 0.98;  // Step shrink per sample once settled
+    static constexpr double restart_threshold = 0.05;  // Hit ratio jump that restarts climbing
+
+    NodeList& region(Region r) {
+        return r == WINDOW ? window : r == PROBATION ? probation : protected_list;
+    }
+
+    double initial_step() const {
+        return step_percent * capacity;
+    }
+
+    // Clamps the window to [1, capacity - 1] and derives the main segments
+    void set_regions() {
+        size_t max_window = capacity > 1 ? capacity - 1 : 1;
+        window_capacity = std::min(std::max<size_t>(1, window_capacity), max_window);
+        main_capacity = capacity > window_capacity ? capacity - window_capacity : 0;
+        protected_capacity = main_capacity * 4 / 5;
+        sample_size = std::max<size_t>(100, 10 * capacity);
+    }
+
+    // Moves a node from its current list to the front of another
+    void move_to(typename NodeList::iterator node, Region to, bool front = true) {
+        NodeList& dest = region(to);
+        dest.splice(front ? dest.begin() : dest.end(), region(node->region), node);
+        node->region = to;
+    }
+
+    // Hit handling: window stays LRU, main is a segmented LRU
+    void touch(typename NodeList::iterator node) {
+        if (node->region == PROBATION) {
+            move_to(node, PROTECTED);
+            rebalance();
+        } else {
+            move_to(node, node->region);
+        }
+    }
+
+    // Restores the region limits after an insert, promotion or climb
+    void rebalance() {
+        // A grown window takes the coldest main entries as its own LRU tail
+        while (probation.size() + protected_list.size() > main_capacity && window.size() < window_capacity) {
+            move_to(std::prev(probation.empty() ? protected_list.end() : probation.end()), WINDOW, false);
+        }
+        while (window.size() > window_capacity) {  // Window overflow graduates to probation
+            move_to(std::prev(window.end()), PROBATION);
+        }
+        while (protected_list.size() > protected_capacity) {  // Protected overflow is demoted
+            move_to(std::prev(protected_list.end()), PROBATION);
+        }
+        while (cache_map.size() > capacity) {  // Evict from probation, then protected, then window
+            NodeList& victims = !probation.empty() ? probation : !protected_list.empty() ? protected_list : window;
+            cache_map.erase(victims.back().key);  // Remove from map
+            victims.pop_back();  // Remove from list
+        }
+    }
+
+    // Records a lookup and adjusts the window once per sample period
+    void sample(bool hit) {
+        hits += hit;
+        if (++samples < sample_size) {
+            return;
+        }
+
+        double hit_rate = double(hits) / samples;
+        double change = hit_rate - previous_hit_rate;
+        double amount = change >= 0 ? step : -step;  // Keep going while it helps, else turn around
+        step = std::abs(change) >= restart_threshold
+            ? initial_step() * (amount >= 0 ? 1 : -1)
+            : step_decay * amount;
+        previous_hit_rate = hit_rate;
+        hits = 0;
+        samples = 0;
+
+        long long target = (long long)window_capacity + std::llround(amount);
+        window_capacity = size_t(std::max<long long>(1, target));
+        set_regions();
+        rebalance();
+    }
+
+    size_t capacity;  // Maximum number of elements in the cache
+    size_t window_capacity;  // Share of capacity given to the admission window
+    size_t main_capacity;  // Remaining capacity for probation + protected
+    size_t protected_capacity;  // Upper bound of the protected segment (80% of main)
+    // Hill climbing state
+    size_t sample_size;
+    size_t samples = 0;
+    size_t hits = 0;
+    double previous_hit_rate = 0;
+    double step;  // Signed step in entries; sign is the current climbing direction
+    // Admission window and main segments, most recently used at the front
+    NodeList window;
+    NodeList probation;
+    NodeList protected_list;
+    // Map to quickly lookup elements in the lists
+    std::unordered_map<KeyType, typename NodeList::iterator> cache_map;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// Importance class of a PriorityLRUCache entry, lowest first
+enum class Priority { BULK, NORMAL, CRITICAL };
+
+// LRU cache with one recency list per Priority and a reserved capacity per
+// class. A class holding no more than its reservation is protected: victims
+// come from the LRU end of the lowest class that is over its reservation, so
+// a burst of bulk data only ever displaces other unreserved entries. If every
+// class is within its reservation (reservations add up to more than the
+// capacity) the lowest class not above the incoming entry's gives way, and an
+// entry that could only displace higher classes is not stored.
+template<typename KeyType, typename ValueType>
+class PriorityLRUCache {
+public:
+    static constexpr size_t class_count = 3;
+
+    // Constructor to init the cache w/ a given capacity and per-class reservations (bulk, normal, critical)
+    explicit PriorityLRUCache(size_t size, std::array<size_t, class_count> reservations = {})
+        : capacity(size), reserved(reservations) {}
+
+    // Function to retrieve a value from the cache
+    ValueType get(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+
+        touch(it->second);
+        return it->second.entry->second;  // Return the value associated with the key
+    }
+
+    // Function to retrieve a value w/o throwing, returns false on a miss
+    bool try_get(const KeyType& key, ValueType& value) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            return false;  // Key not found
+        }
+
+        touch(it->second);
+        value = it->second.entry->second;
+        return true;
+    }
+
+    // Function to insert or update a value; an update may also move the entry to another class
+    void put(const KeyType& key, const ValueType& value, Priority priority = Priority::NORMAL) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Check if key already exists in the cache
+        if (it != cache_map.end()) {
+            Locator& locator = it->second;
+            EntryList& target = lists[index(priority)];
+            target.splice(target.begin(), lists[locator.priority], locator.entry);  // -> MRU of its new class
+            locator.priority = index(priority);
+            locator.entry->second = value;  // Update the value
+            return;
+        }
+
+        // If cache full, evict by class; give up if only higher classes could make room
+        if (cache_map.size() >= capacity && !evict(index(priority))) {
+            return;
+        }
+
+        EntryList& target = lists[index(priority)];
+        target.emplace_front(key, value);
+        cache_map[key] = Locator{index(priority), target.begin()};
+    }
+
+    // Function to remove an object from the cache if it exists, returns whether it did
+    bool erase(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        auto it = cache_map.find(key);  // Find the key in the map
+        if (it == cache_map.end()) {
+            return false;
+        }
+        lists[it->second.priority].erase(it->second.entry);  // Remove from its class list
+        cache_map.erase(it);  // Remove from map
+        return true;
+    }
+
+    // Function to dynamically adjust the cache's capacity
+    void resize(size_t new_capacity) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        while (cache_map.size() > new_capacity) {  // Same victim order as put, any class may go
+            evict(class_count - 1);
+        }
+        capacity = new_capacity;  // Set the new capacity
+    }
+
+    // Function to change the capacity protected for one class
+    void reserve(Priority priority, size_t entries) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        reserved[index(priority)] = entries;
+    }
+
+    // Number of cached entries in one class
+    size_t size(Priority priority) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return lists[index(priority)].size();
+    }
+
+private:
+    typedef std::list<std::pair<KeyType, ValueType>> EntryList;
+
+    struct Locator {
+        size_t priority;  // Index of the list holding the entry
+        typename EntryList::iterator entry;
+    };
+
+    static size_t index(Priority priority) {
+        return static_cast<size_t>(priority);
+    }
+
+    void touch(Locator& locator) {
+        EntryList& list = lists[locator.priority];
+        list.splice(list.begin(), list, locator.entry); // Moves accessed node
+    }
+
+    // Evicts one entry on behalf of an insert of class incoming; returns false if
+    // the only candidates are reserved entries of higher classes
+    bool evict(size_t incoming) {
+        size_t victim = class_count;
+        for (size_t c = 0; c < class_count && victim == class_count; ++c) {
+            if (lists[c].size() > reserved[c]) {
+                victim = c;  // Lowest class over its reservation
+            }
+        }
+        for (size_t c = 0; c <= incoming && victim == class_count; ++c) {
+            if (!lists[c].empty()) {
+                victim = c;  // All within reservations: lowest class that isn't above the newcomer
+            }
+        }
+        if (victim == class_count) {
+            return false;
+        }
+        cache_map.erase(lists[victim].back().first);  // Remove from map
+        lists[victim].pop_back();  // Remove from list
+        return true;
+    }
+
+    size_t capacity;  // Maximum number of elements in the cache
+    std::array<size_t, class_count> reserved;  // Entries per class protected from other classes
+    std::array<EntryList, class_count> lists;  // Per-class recency, most recently used at the front
+    // Map to quickly lookup elements and their class
+    std::unordered_map<KeyType, Locator> cache_map;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// Per-tenant counters reported by TenantLRUCache
+struct TenantStats {
+    size_t size;  // Entries currently cached
+    size_t hits;
+    size_t misses;
+    size_t evictions;  // Entries pushed out by capacity or quota pressure
+};
+
+// One cache shared by many tenants. Each tenant has a soft quota, the share it
+// keeps under pressure, and a hard quota it can never exceed. When the shared
+// capacity runs out the victim is the LRU entry of the tenant furthest over
+// its soft quota, so a noisy tenant evicts its own data first; a tenant at its
+// hard quota always replaces its own LRU entry. If soft quotas overcommit the
+// capacity and nobody is over theirs, a tenant can only replace its own
+// entries. All tenants share the cache's single lock.
+template<typename TenantId, typename KeyType, typename ValueType>
+class TenantLRUCache {
+public:
+    // Constructor to init the cache w/ a shared capacity and the quotas tenants start with
+    explicit TenantLRUCache(size_t size, size_t default_soft_quota = 0, size_t default_hard_quota = SIZE_MAX)
+        : capacity(size), default_soft(default_soft_quota), default_hard(default_hard_quota) {}
+
+    // Function to retrieve a tenant's value from the cache
+    ValueType get(const TenantId& tenant, const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        Tenant& owner = tenant_for(tenant);
+        auto it = cache_map.find(MapKey(tenant, key));  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            ++owner.misses;
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+
+        ++owner.hits;
+        owner.entries.splice(owner.entries.begin(), owner.entries, it->second); // Moves accessed node
+        return it->second->second;  // Return the value associated with the key
+    }
+
+    // Function to retrieve a value w/o throwing, returns false on a miss
+    bool try_get(const TenantId& tenant, const KeyType& key, ValueType& value) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        Tenant& owner = tenant_for(tenant);
+        auto it = cache_map.find(MapKey(tenant, key));  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            ++owner.misses;
+            return false;  // Key not found
+        }
+
+        ++owner.hits;
+        owner.entries.splice(owner.entries.begin(), owner.entries, it->second); // Moves accessed node
+        value = it->second->second;
+        return true;
+    }
+
+    // Function to insert or update a tenant's value in the cache
+    void put(const TenantId& tenant, const KeyType& key, const ValueType& value) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        Tenant& owner = tenant_for(tenant);
+        auto it = cache_map.find(MapKey(tenant, key));  // Check if key already exists in the cache
+        if (it != cache_map.end()) {
+            // If key exists -> MRU
+            owner.entries.splice(owner.entries.begin(), owner.entries, it->second);
+            it->second->second = value;  // Update the value
+            return;
+        }
+
+        if (owner.hard_quota == 0) {
+            return;  // Tenant may not store anything
+        }
+        if (owner.entries.size() >= owner.hard_quota) {
+            evict(owner);  // At the hard quota: replace own LRU entry
+        } else if (size >= capacity) {
+            Tenant* victim = over_quota.empty() ? &owner : over_quota.rbegin()->second;
+            if (victim->entries.empty()) {
+                return;  // Nobody over quota and nothing of our own to replace
+            }
+            evict(*victim);
+        }
+
+        owner.entries.emplace_front(key, value);
+        cache_map[MapKey(tenant, key)] = owner.entries.begin();
+        ++size;
+        update_quota_order(owner, owner.entries.size() - 1);
+    }
+
+    // Function to remove a tenant's object from the cache if it exists, returns whether it did
+    bool erase(const TenantId& tenant, const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        auto it = cache_map.find(MapKey(tenant, key));  // Find the key in the map
+        if (it == cache_map.end()) {
+            return false;
+        }
+        Tenant& owner = tenants.find(tenant)->second;
+        owner.entries.erase(it->second);  // Remove from the tenant's list
+        cache_map.erase(it);  // Remove from map
+        --size;
+        update_quota_order(owner, owner.entries.size() + 1);
+        return true;
+    }
+
+    // Function to dynamically adjust the shared capacity
+    void resize(size_t new_capacity) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        while (size > new_capacity) {  // Furthest over quota first, then the largest tenant
+            evict(over_quota.empty() ? largest_tenant() : *over_quota.rbegin()->second);
+        }
+        capacity = new_capacity;  // Set the new capacity
+    }
+
+    // Function to set a tenant's quotas; entries above a lowered hard quota are evicted
+    void set_quota(const TenantId& tenant, size_t soft_quota, size_t hard_quota) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        Tenant& owner = tenant_for(tenant);
+        size_t count = owner.entries.size();
+        remove_from_quota_order(owner, count);
+        owner.soft_quota = soft_quota;
+        owner.hard_quota = hard_quota;
+        update_quota_order(owner, count);
+        while (owner.entries.size() > hard_quota) {
+            evict(owner);
+        }
+    }
+
+    TenantStats stats(const TenantId& tenant) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = tenants.find(tenant);
+        if (it == tenants.end()) {
+            return TenantStats{0, 0, 0, 0};
+        }
+        const Tenant& t = it->second;
+        return TenantStats{t.entries.size(), t.hits, t.misses, t.evictions};
+    }
+
+private:
+    typedef std::list<std::pair<KeyType, ValueType>> EntryList;
+    typedef std::pair<TenantId, KeyType> MapKey;
+
+    struct MapKeyHash {
+        size_t operator()(const MapKey& key) const {
+            size_t h = std::hash<TenantId>()(key.first);
+            return h ^ (std::hash<KeyType>()(key.second) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+        }
+    };
+
+    struct Tenant {
+        TenantId id;
+        size_t soft_quota;
+        size_t hard_quota;
+        EntryList entries;  // This tenant's entries, most recently used at the front
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+    };
+
+    Tenant& tenant_for(const TenantId& tenant) {
+        auto it = tenants.find(tenant);
+        if (it == tenants.end()) {
+            it = tenants.emplace(tenant, Tenant{tenant, default_soft, default_hard, EntryList()}).first;
+        }
+        return it->second;
+    }
+
+    // Keeps over_quota in step after a tenant's entry count changed from old_count
+    void update_quota_order(Tenant& t, size_t old_count) {
+        remove_from_quota_order(t, old_count);
+        if (t.entries.size() > t.soft_quota) {
+            over_quota.emplace(t.entries.size() - t.soft_quota, &t);
+        }
+    }
+
+    void remove_from_quota_order(Tenant& t, size_t old_count) {
+        if (old_count > t.soft_quota) {
+            over_quota.erase(std::make_pair(old_count - t.soft_quota, &t));
+        }
+    }
+
+    Tenant& largest_tenant() {
+        Tenant* largest = nullptr;
+        for (auto& entry : tenants) {
+            if (largest == nullptr || entry.second.entries.size() > largest->entries.size()) {
+                largest = &entry.second;
+            }
+        }
+        return *largest;
+    }
+
+    void evict(Tenant& t) {
+        cache_map.erase(MapKey(t.id, t.entries.back().first));  // Remove from map
+        t.entries.pop_back();  // Remove from list
+        ++t.evictions;
+        --size;
+        update_quota_order(t, t.entries.size() + 1);
+    }
+
+    size_t capacity;  // Maximum number of elements across all tenants
+    size_t size = 0;  // Elements across all tenants
+    size_t default_soft;  // Quotas given to tenants seen for the first time
+    size_t default_hard;
+    std::unordered_map<TenantId, Tenant> tenants;  // Node-based, so Tenant addresses are stable
+    // Tenants above their soft quota, ordered by how far above
+    std::set<std::pair<size_t, Tenant*>> over_quota;
+    // Map to quickly lookup elements in the tenants' lists
+    std::unordered_map<MapKey, typename EntryList::iterator, MapKeyHash> cache_map;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// LRU cache of shared objects that doesn't have to keep them alive by itself.
+// The strong_size most recently used entries hold a std::shared_ptr; when that
+// limit is exceeded (or lowered with set_strong_size() under memory pressure)
+// the LRU strong entry is demoted to a std::weak_ptr instead of being evicted,
+// so it stays reachable for as long as anyone else, e.g. an in-flight request,
+// holds the object, and vanishes when the last holder lets go. A hit on a live
+// weak entry promotes it back. strong_size 0 gives weak-value mode, where the
+// cache only dedupes objects others keep alive. The capacity counts weak
+// entries too; expired ones are dropped when looked up and by purge().
+// Released objects are destroyed after the lock, never under it.
+template<typename KeyType, typename T>
+class SoftLRUCache {
+public:
+    typedef std::shared_ptr<T> Pointer;
+
+    // Constructor to init the cache w/ a given capacity and number of strongly held entries
+    explicit SoftLRUCache(size_t size, size_t strong_size = 0) : capacity(size), strong_capacity(strong_size) {}
+
+    // Function to retrieve a value from the cache; an expired weak entry counts as a miss
+    Pointer get(const KeyType& key) {
+        EntryList garbage;  // Declared first so they're freed after unlocking
+        Pointer released;
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        Pointer object = lookup(key, garbage, released);
+        if (!object) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+        return object;
+    }
+
+    // Function to retrieve a value w/o throwing, returns false on a miss
+    bool try_get(const KeyType& key, Pointer& value) {
+        EntryList garbage;  // Declared first so they're freed after unlocking
+        Pointer released;
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        Pointer object = lookup(key, garbage, released);
+        if (!object) {
+            return false;  // Key not found
+        }
+        value = std::move(object);
+        return true;
+    }
+
+    // Function to insert or update a value in the cache, as its MRU strong entry
+    void put(const KeyType& key, const Pointer& value) {
+        EntryList garbage;  // Declared first so they're freed after unlocking
+        Pointer released;
+        garbage.push_front(Entry{key, value, value, true});  // Build the new node before taking the lock
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Check if key already exists in the cache
+        if (it != cache_map.end()) {
+            garbage.splice(garbage.end(), list_of(*it->second), it->second);  // Old entry goes to garbage
+            cache_map.erase(it);
+        }
+        insert(garbage, released);
+    }
+
+    // Function to insert a value unless the key already has a live one. Returns
+    // the object the cache ends up with, so concurrent loaders of the same key
+    // can all continue with a single copy.
+    Pointer put_if_absent(const KeyType& key, const Pointer& value) {
+        EntryList garbage;  // Declared first so they're freed after unlocking
+        Pointer released;
+        garbage.push_front(Entry{key, value, value, true});  // Build the new node before taking the lock
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        if (Pointer existing = lookup(key, garbage, released)) {
+            return existing;
+        }
+        insert(garbage, released);
+        return value;
+    }
+
+    // Function to remove an object from the cache if it exists, returns whether it did
+    bool erase(const KeyType& key) {
+        EntryList garbage;  // Freed after unlocking
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        auto it = cache_map.find(key);  // Find the key in the map
+        if (it == cache_map.end()) {
+            return false;
+        }
+        garbage.splice(garbage.end(), list_of(*it->second), it->second);  // Remove from its list
+        cache_map.erase(it);  // Remove from map
+        return true;
+    }
+
+    // Function to dynamically adjust the cache's capacity
+    void resize(size_t new_capacity) {
+        EntryList garbage;  // Freed after unlocking
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        while (cache_map.size() > new_capacity) {
+            evict(garbage);
+        }
+        capacity = new_capacity;  // Set the new capacity
+    }
+
+    // Function to change how many entries are held strongly; lowering it demotes
+    // the excess LRU entries to weak at once, e.g. from a memory pressure handler
+    void set_strong_size(size_t strong_size) {
+        std::vector<Pointer> released;  // Freed after unlocking
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        strong_capacity = strong_size;
+        while (strong_list.size() > strong_capacity) {
+            released.push_back(demote());
+        }
+    }
+
+    // Function to drop weak entries whose objects are gone, returns how many
+    size_t purge() {
+        EntryList garbage;  // Freed after unlocking
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        for (auto it = weak_list.begin(); it != weak_list.end();) {
+            auto entry = it++;
+            if (entry->weak.expired()) {
+                cache_map.erase(entry->key);
+                garbage.splice(garbage.end(), weak_list, entry);
+            }
+        }
+        return garbage.size();
+    }
+
+    // Number of entries, weak ones included (some may have expired since)
+    size_t size() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return cache_map.size();
+    }
+
+    // Number of entries currently holding their object strongly
+    size_t strong_size() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return strong_list.size();
+    }
+
+private:
+    struct Entry {
+        KeyType key;
+        Pointer object;  // Empty once demoted
+        std::weak_ptr<T> weak;
+        bool strong;  // Which list the entry is in
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    EntryList& list_of(const Entry& entry) {
+        return entry.strong ? strong_list : weak_list;
+    }
+
+    // Finds a live entry and makes it MRU, promoting a weak one. An expired
+    // entry is moved to garbage; a strong reference displaced by the promotion
+    // goes to released.
+    Pointer lookup(const KeyType& key, EntryList& garbage, Pointer& released) {
+        auto it = cache_map.find(key);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            return nullptr;
+        }
+        auto entry = it->second;
+        if (entry->strong) {
+            strong_list.splice(strong_list.begin(), strong_list, entry); // Moves accessed node
+            return entry->object;
+        }
+        Pointer object = entry->weak.lock();
+        if (!object) {
+            garbage.splice(garbage.end(), weak_list, entry);  // Expired: drop it
+            cache_map.erase(it);
+            return nullptr;
+        }
+        if (strong_capacity == 0) {
+            weak_list.splice(weak_list.begin(), weak_list, entry); // Moves accessed node
+            return object;
+        }
+        entry->object = object;  // Promote
+        entry->strong = true;
+        strong_list.splice(strong_list.begin(), weak_list, entry);
+        if (strong_list.size() > strong_capacity) {
+            released = demote();
+        }
+        return object;
+    }
+
+    // Inserts the first entry of garbage as the MRU strong entry
+    void insert(EntryList& garbage, Pointer& released) {
+        if (capacity == 0) {
+            return;  // Nothing can be stored; the entry is freed with garbage
+        }
+        if (cache_map.size() >= capacity) {
+            evict(garbage);  // If cache full, evict the LRU item
+        }
+        strong_list.splice(strong_list.begin(), garbage, garbage.begin());
+        cache_map[strong_list.front().key] = strong_list.begin();
+        if (strong_list.size() > strong_capacity) {
+            released = demote();
+        }
+    }
+
+    // Weak entries go first; strong ones only once no weak entry is left
+    void evict(EntryList& garbage) {
+        EntryList& victims = weak_list.empty() ? strong_list : weak_list;
+        if (victims.empty()) {
+            return;
+        }
+        cache_map.erase(victims.back().key);  // Remove from map
+        garbage.splice(garbage.end(), victims, std::prev(victims.end()));  // Remove from list
+    }
+
+    // Demotes the LRU strong entry, returning the reference for release after unlocking
+    Pointer demote() {
+        auto entry = std::prev(strong_list.end());
+        Pointer object = std::move(entry->object);
+        entry->strong = false;
+        weak_list.splice(weak_list.begin(), strong_list, entry);  // MRU of the weak entries
+        return object;
+    }
+
+    size_t capacity;  // Maximum number of entries, weak ones included
+    size_t strong_capacity;  // Maximum number of strongly held entries
+    EntryList strong_list;  // Most recently used first
+    EntryList weak_list;  // Demoted entries, most recently used first
+    // Map to quickly lookup elements in either list
+    std::unordered_map<KeyType, typename EntryList::iterator> cache_map;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// Type-erased value with InlineSize bytes of in-object storage. Types that fit
+// (and aren't over-aligned) are constructed in place, so no allocation happens;
+// larger ones go on the heap. The stored type is identified by the address of
+// a per-type descriptor, so checks are one pointer compare with no RTTI.
+template<size_t InlineSize>
+class InlineValue {
+public:
+    // Per-type operations; its address doubles as the type's identity
+    struct TypeInfo {
+        void (*destroy)(void* storage);
+    };
+
+    template<typename T>
+    static constexpr bool stored_inline =
+        sizeof(T) <= InlineSize && alignof(T) <= alignof(std::max_align_t);
+
+    template<typename T, typename... Args>
+    explicit InlineValue(std::in_place_type_t<T>, Args&&... args) : type(&info<T>) {
+        if constexpr (stored_inline<T>) {
+            new (storage) T(std::forward<Args>(args)...);
+        } else {
+            T* value = new T(std::forward<Args>(args)...);
+            std::memcpy(storage, &value, sizeof(value));
+        }
+    }
+
+    ~InlineValue() {
+        type->destroy(storage);
+    }
+
+    // Entries never move (they live in list nodes), so no copy or move is needed
+    InlineValue(const InlineValue&) = delete;
+    InlineValue& operator=(const InlineValue&) = delete;
+
+    template<typename T>
+    bool holds() const {
+        return type == &info<T>;
+    }
+
+    // Returns the value if it has type T, else nullptr
+    template<typename T>
+    const T* get_if() const {
+        if (!holds<T>()) {
+            return nullptr;
+        }
+        if constexpr (stored_inline<T>) {
+            return std::launder(reinterpret_cast<const T*>(storage));
+        } else {
+            T* value;
+            std::memcpy(&value, storage, sizeof(value));
+            return value;
+        }
+    }
+
+    const TypeInfo* type_info() const {
+        return type;
+    }
+
+    template<typename T>
+    static const TypeInfo* type_info_for() {
+        return &info<T>;
+    }
+
+private:
+    static_assert(InlineSize >= sizeof(void*), "Inline storage must fit a heap pointer");
+
+    template<typename T>
+    static void destroy(void* storage) {
+        if constexpr (stored_inline<T>) {
+            std::launder(reinterpret_cast<T*>(storage))->~T();
+        } else {
+            T* value;
+            std::memcpy(&value, storage, sizeof(value));
+            delete value;
+        }
+    }
+
+    template<typename T>
+    static inline const TypeInfo info = {&destroy<T>};
+
+    alignas(std::max_align_t) unsigned char storage[InlineSize];
+    const TypeInfo* type;
+};
+
+// LRU cache whose entries may each hold a different type. Values are stored in
+// InlineValue, so anything up to InlineSize bytes lives inside the list node
+// with no extra allocation (unlike std::any or shared_ptr<void>). get<T>
+// checks the type with a pointer compare. Every entry carries a caller-given
+// weight (default 1, e.g. bytes) and totals are kept per type.
+template<typename KeyType, size_t InlineSize = 32>
+class HeterogeneousLRUCache {
+public:
+    // Constructor to init the cache w/ a given capacity
+    explicit HeterogeneousLRUCache(size_t size) : capacity(size) {}
+
+    // Function to retrieve a copy of a value, throws std::bad_any_cast if it isn't a T
+    template<typename T>
+    T get(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+
+        const T* value = it->second->value.template get_if<T>();
+        if (value == nullptr) {
+            throw std::bad_any_cast();  // Stored under a different type
+        }
+        usage_list.splice(usage_list.begin(), usage_list, it->second); // Moves accessed node
+        return *value;
+    }
+
+    // Function to retrieve a value w/o throwing, returns false on a miss or a type mismatch
+    template<typename T>
+    bool try_get(const KeyType& key, T& value) {
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Attempt to find the key in the hash map
+        if (it == cache_map.end()) {
+            return false;
+        }
+        const T* stored = it->second->value.template get_if<T>();
+        if (stored == nullptr) {
+            return false;
+        }
+        usage_list.splice(usage_list.begin(), usage_list, it->second); // Moves accessed node
+        value = *stored;
+        return true;
+    }
+
+    // Function to insert or replace a value of any type
+    template<typename T>
+    void put(const KeyType& key, T&& value, size_t weight = 1) {
+        typedef typename std::decay<T>::type Stored;
+        EntryList garbage;  // Declared first so removed entries are freed after unlocking
+        garbage.emplace_front(key, weight, std::in_place_type<Stored>, std::forward<T>(value));
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock for thread safety
+        auto it = cache_map.find(key);  // Check if key already exists in the cache
+        if (it != cache_map.end()) {
+            // If key exists -> new entry becomes MRU, the old one goes to garbage
+            usage_list.splice(usage_list.begin(), garbage, garbage.begin());
+            unlink(it->second, garbage);
+            add_weight(usage_list.front());
+            it->second = usage_list.begin();
+            return;
+        }
+
+        // If cache full, evict the LRU item
+        if (usage_list.size() >= capacity) {
+            if (capacity == 0) {
+                return;  // Nothing can be stored
+            }
+            auto last = std::prev(usage_list.end());
+            cache_map.erase(last->key);  // Remove from map
+            unlink(last, garbage);
+        }
+
+        usage_list.splice(usage_list.begin(), garbage, garbage.begin());
+        add_weight(usage_list.front());
+        cache_map[key] = usage_list.begin();
+    }
+
+    // Function to remove an object from the cache if it exists, returns whether it did
+    bool erase(const KeyType& key) {
+        EntryList garbage;  // Freed after unlocking
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        auto it = cache_map.find(key);  // Find the key in the map
+        if (it == cache_map.end()) {
+            return false;
+        }
+        unlink(it->second, garbage);
+        cache_map.erase(it);  // Remove from map
+        return true;
+    }
+
+    // Function to dynamically adjust the cache's capacity
+    void resize(size_t new_capacity) {
+        EntryList garbage;  // Freed after unlocking
+        std::lock_guard<std::mutex> lock(cache_mutex); // Lock to ensure thread safety
+        while (usage_list.size() > new_capacity) {  // If current size is larger than new capacity, reduce size
+            auto last = std::prev(usage_list.end());
+            cache_map.erase(last->key);  // Remove least recently used items
+            unlink(last, garbage);
+        }
+        capacity = new_capacity;  // Set the new capacity
+    }
+
+    // Whether key is cached with a value of type T; doesn't count as a use
+    template<typename T>
+    bool holds(const KeyType& key) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache_map.find(key);
+        return it != cache_map.end() && it->second->value.template holds<T>();
+    }
+
+    // Sum of the weights of all cached values of type T
+    template<typename T>
+    size_t weight() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = type_weights.find(Value::template type_info_for<typename std::decay<T>::type>());
+        return it == type_weights.end() ? 0 : it->second;
+    }
+
+    // Sum of the weights of all cached values
+    size_t total_weight() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return weight_sum;
+    }
+
+private:
+    typedef InlineValue<InlineSize> Value;
+
+    struct Entry {
+        template<typename T, typename... Args>
+        Entry(const KeyType& key, size_t weight, std::in_place_type_t<T> type, Args&&... args)
+            : key(key), weight(weight), value(type, std::forward<Args>(args)...) {}
+
+        KeyType key;
+        size_t weight;
+        Value value;
+    };
+    typedef std::list<Entry> EntryList;
+
+    void add_weight(const Entry& entry) {
+        type_weights[entry.value.type_info()] += entry.weight;
+        weight_sum += entry.weight;
+    }
+
+    // Moves an entry out of usage_list into garbage, dropping its weight
+    void unlink(typename EntryList::iterator entry, EntryList& garbage) {
+        auto weights = type_weights.find(entry->value.type_info());
+        weights->second -= entry->weight;
+        if (weights->second == 0) {
+            type_weights.erase(weights);
+        }
+        weight_sum -= entry->weight;
+        garbage.splice(garbage.end(), usage_list, entry);
+    }
+
+    size_t capacity;  // Maximum number of elements in the cache
+    size_t weight_sum = 0;  // Total weight over all types
+    // List to track the least recent to most recently used objects
+    EntryList usage_list;
+    // Map to quickly lookup elements in the list
+    std::unordered_map<KeyType, typename EntryList::iterator> cache_map;
+    // Weight per stored type, keyed by the type's descriptor
+    std::unordered_map<const typename Value::TypeInfo*, size_t> type_weights;
+    std::mutex cache_mutex;  // Mutex to make class thread-safe
+};
+
+// Lets FixedLRUCache be constexpr under C++20 while keeping SIMD at run time
+#if defined(__cpp_lib_is_constant_evaluated)
+#define THREADSAFE_FIXED_CONSTEXPR constexpr
+#define THREADSAFE_AT_RUNTIME (!std::is_constant_evaluated())
+#else
+#define THREADSAFE_FIXED_CONSTEXPR
+#define THREADSAFE_AT_RUNTIME true
+#endif
+
+// Allocation-free LRU cache with compile-time capacity N, for memoizing a
+// handful of lookups per request. All storage is inline std::arrays so it can
+// live on the stack and inline completely. Each slot has a 1-byte tag (7 hash
+// bits + an occupied bit); lookups compare 16 tags at a time with SSE2 and
+// only compare keys whose tag matches. Unlike the other caches this one has no
+// mutex: it is meant to be owned by a single request or thread. Under C++20
+// every operation is constexpr as long as Hash is.
+template<typename KeyType, typename ValueType, size_t N, typename Hash = std::hash<KeyType>>
+class FixedLRUCache {
+    static_assert(N > 0 && N < 65535, "FixedLRUCache capacity must be in [1, 65534]");
+
+public:
+    constexpr FixedLRUCache() = default;
+
+    // Function to retrieve a value from the cache
+    THREADSAFE_FIXED_CONSTEXPR ValueType get(const KeyType& key) {
+        const ValueType* value = find(key);
+        if (value == nullptr) {
+            throw std::range_error("Key not found");  // Key not found, throw exception
+        }
+        return *value;
+    }
+
+    // Function to retrieve a value w/o throwing, returns false on a miss
+    THREADSAFE_FIXED_CONSTEXPR bool try_get(const KeyType& key, ValueType& value) {
+        const ValueType* found = find(key);
+        if (found == nullptr) {
+            return false;
+        }
+        value = *found;
+        return true;
+    }
+
+    // Returns the cached value in place (marking it most recently used), or nullptr
+    THREADSAFE_FIXED_CONSTEXPR ValueType* find(const KeyType& key) {
+        Index slot = find_slot(key, tag_of(key));
+        if (slot == nil) {
+            return nullptr;
+        }
+        move_to_front(slot);
+        return &values[slot];
+    }
+
+    // Function to insert or update a value in the cache
+    THREADSAFE_FIXED_CONSTEXPR void put(const KeyType& key, const ValueType& value) {
+        uint8_t tag = tag_of(key);
+        Index slot = find_slot(key, tag);
+        if (slot != nil) {
+            values[slot] = value;  // Update the value
+            move_to_front(slot);
+            return;
+        }
+
+        if (count == N) {
+            slot = tail;  // Reuse the LRU slot
+            unlink(slot);
+        } else {
+            slot = free_slot();
+            ++count;
+        }
+        tags[slot] = tag;
+        keys[slot] = key;
+        values[slot] = value;
+        push_front(slot);
+    }
+
+    // Function to remove an object from the cache if it exists, returns whether it did
+    THREADSAFE_FIXED_CONSTEXPR bool erase(const KeyType& key) {
+        Index slot = find_slot(key, tag_of(key));
+        if (slot == nil) {
+            return false;
+        }
+        unlink(slot);
+        tags[slot] = 0;
+        --count;
+        return true;
+    }
+
+    constexpr size_t size() const {
+        return count;
+    }
+
+    static constexpr size_t capacity() {
+        return N;
+    }
+
+private:
+    typedef typename std::conditional<(N < 255), uint8_t, uint16_t>::type Index;
+    static constexpr Index nil = Index(N);
+    static constexpr size_t tag_count = (N + 15) / 16 * 16;  // Padded with empty tags for 16-wide loads
+
+    static THREADSAFE_FIXED_CONSTEXPR uint8_t tag_of(const KeyType& key) {
+        uint64_t h = uint64_t(Hash()(key)) * 0x9e3779b97f4a7c15ull;  // Spread weak hashes into the top bits
+        return uint8_t(h >> 57) | 0x80;
+    }
+
+    // Index of the slot holding key, or nil
+    THREADSAFE_FIXED_CONSTEXPR Index find_slot(const KeyType& key, uint8_t tag) const {
+#if defined(__SSE2__)
+        if (THREADSAFE_AT_RUNTIME) {
+            const __m128i needle = _mm_set1_epi8(char(tag));
+            for (size_t i = 0; i < tag_count; i += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&tags[i]));
+                unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+                while (mask != 0) {
+                    size_t slot = i + unsigned(__builtin_ctz(mask));  // Padding tags never match
+                    if (keys[slot] == key) {
+                        return Index(slot);
+                    }
+                    mask &= mask - 1;
+                }
+            }
+            return nil;
+        }
+#endif
+        for (size_t slot = 0; slot < N; ++slot) {
+            if (tags[slot] == tag && keys[slot] == key) {
+                return Index(slot);
+            }
+        }
+        return nil;
+    }
+
+    // First empty slot; only called while count < N
+    THREADSAFE_FIXED_CONSTEXPR Index free_slot() const {
+#if defined(__SSE2__)
+        if (THREADSAFE_AT_RUNTIME) {
+            for (size_t i = 0; i < tag_count; i += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&tags[i]));
+                unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128())));
+                if (mask != 0) {
+                    return Index(i + unsigned(__builtin_ctz(mask)));
+                }
+            }
+        }
+#endif
+        for (size_t slot = 0; slot < N; ++slot) {
+            if (tags[slot] == 0) {
+                return Index(slot);
+            }
+        }
+        return nil;
+    }
+
+    THREADSAFE_FIXED_CONSTEXPR void unlink(Index slot) {
+        (prev[slot] == nil ? head : next[prev[slot]]) = next[slot];
+        (next[slot] == nil ? tail : prev[next[slot]]) = prev[slot];
+    }
+
+    THREADSAFE_FIXED_CONSTEXPR void push_front(Index slot) {
+        prev[slot] = nil;
+        next[slot] = head;
+        (head == nil ? tail : prev[head]) = slot;
+        head = slot;
+    }
+
+    THREADSAFE_FIXED_CONSTEXPR void move_to_front(Index slot) {
+        if (slot != head) {
+            unlink(slot);
+            push_front(slot);
+        }
+    }
+
+    std::array<uint8_t, tag_count> tags{};  // 0 = empty slot
+    std::array<KeyType, N> keys{};
+    std::array<ValueType, N> values{};
+    // Recency list threaded through the slots, most recently used at head
+    std::array<Index, N> prev{};
+    std::array<Index, N> next{};
+    Index head = nil;
+    Index tail = nil;
+    size_t count = 0;
+};
+
+#endif // THREADSAFE_H
@@ -0,0 +1,73 @@
+#ifndef THREADSAFETRACE_H
+#define THREADSAFETRACE_H
+
+// USDT probes in the sys/sdt.h (stapsdt) note format, emitted directly so no
+// systemtap headers or libraries are needed. bpftrace, perf and SystemTap can
+// attach to a live process, e.g.
+//   bpftrace -e 'usdt:./threadSafe:threadsafe:get_miss { @[pid] = count(); }'
+// Each probe site is one nop plus an ELF note describing where its arguments
+// live, so an unattached probe costs a nop. Define THREADSAFE_NO_USDT to
+// compile the probes out entirely.
+//
+// Probes (provider "threadsafe"; arg0 is always the cache's address):
+//   get_hit(cache, key*)          get_miss(cache, key*)
+//   put(cache, key*, size)        evict(cache, key*)
+//   resize(cache, old, new)       lock_contended(cache)    lock_acquired(cache)
+
+#include <type_traits>
+
+#if !defined(THREADSAFE_NO_USDT) && defined(__GNUC__) && defined(__ELF__) \
+    && (defined(__x86_64__) || defined(__aarch64__))
+
+// Argument size as sdt.h encodes it: negative for signed types. The asm
+// template prints it with %n, which negates, so the sign is inverted here.
+#define THREADSAFE_USDT_SIZE(x) \
+    ((std::is_signed<typename std::decay<decltype(x)>::type>::value ? 1 : -1) * int(sizeof(x)))
+#define THREADSAFE_USDT_ARG(n) "%n[s" #n "]@%[a" #n "]"
+#define THREADSAFE_USDT_OPERAND(n, x) [s##n] "n"(THREADSAFE_USDT_SIZE(x)), [a##n] "nor"(x)
+
+#define THREADSAFE_USDT_NOTE(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f,994f-993f,3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"threadsafe\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base,1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+#define THREADSAFE_PROBE1(name, a1) \
+    __asm__ __volatile__(THREADSAFE_USDT_NOTE(name, THREADSAFE_USDT_ARG(1)) \
+                         :: THREADSAFE_USDT_OPERAND(1, a1))
+#define THREADSAFE_PROBE2(name, a1, a2) \
+    __asm__ __volatile__(THREADSAFE_USDT_NOTE(name, THREADSAFE_USDT_ARG(1) " " THREADSAFE_USDT_ARG(2)) \
+                         :: THREADSAFE_USDT_OPERAND(1, a1), THREADSAFE_USDT_OPERAND(2, a2))
+#define THREADSAFE_PROBE3(name, a1, a2, a3) \
+    __asm__ __volatile__(THREADSAFE_USDT_NOTE(name, THREADSAFE_USDT_ARG(1) " " THREADSAFE_USDT_ARG(2) " " \
+                                              THREADSAFE_USDT_ARG(3)) \
+                         :: THREADSAFE_USDT_OPERAND(1, a1), THREADSAFE_USDT_OPERAND(2, a2), \
+                            THREADSAFE_USDT_OPERAND(3, a3))
+
+#else
+
+#define THREADSAFE_PROBE1(name, a1) ((void)0)
+#define THREADSAFE_PROBE2(name, a1, a2) ((void)0)
+#define THREADSAFE_PROBE3(name, a1, a2, a3) ((void)0)
+
+#endif
+
+#endif // THREADSAFETRACE_H